@@ -0,0 +1,198 @@
+//=============================================================================
+// block_pool.cpp - A pool of reference-counted memory blocks
+//=============================================================================
+#include <cstdlib>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include "block_pool.h"
+#include "usdt_probes.h"
+
+using namespace std;
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CBlockPool::CBlockPool(size_t block_size, uint32_t max_blocks, CMemoryBudget* budget)
+{
+    if (block_size == 0 || max_blocks == 0)
+        throwRuntime("Bad block pool geometry: %zu x %u", block_size, max_blocks);
+
+    block_size_ = block_size;
+    max_blocks_ = max_blocks;
+    budget_     = budget;
+    blocks_.assign(max_blocks, nullptr);
+    free_head_  = 0;
+    allocated_  = 0;
+    in_use_     = 0;
+
+    throttle_events_ = 0;
+    throttled_ns_    = 0;
+
+    if (budget_ && footprint() > budget_->stats().limit)
+        throwRuntime("A %zu-byte block won't fit in the memory budget", block_size);
+}
+//=============================================================================
+
+
+//=============================================================================
+// Destructor - Frees every block
+//=============================================================================
+CBlockPool::~CBlockPool()
+{
+    for (pool_block_t* block : blocks_)
+    {
+        if (block)
+        {
+            block->~pool_block_t();
+            free(block);
+            if (budget_) budget_->release(footprint());
+        }
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// allocate() - Allocates a new block, if we haven't reached the limit
+//=============================================================================
+pool_block_t* CBlockPool::allocate()
+{
+    // If we're already at the limit, don't bother the budget
+    if (allocated_.load() >= max_blocks_) return nullptr;
+
+    // Charge the block against the budget, if there's room
+    size_t bytes = footprint();
+    if (budget_ && !budget_->try_reserve(bytes)) return nullptr;
+
+    // Allocate the block header and data together, cache-line aligned.  
+    // This is done before an index is claimed, so that if it fails there's
+    // only the budget to give back.
+    void* memory = aligned_alloc(64, bytes);
+    if (memory == nullptr)
+    {
+        if (budget_) budget_->release(bytes);
+        throw bad_alloc();
+    }
+
+    // Claim an index for the new block, unless they're all taken
+    uint32_t index = allocated_.load();
+    do
+    {
+        if (index >= max_blocks_)
+        {
+            free(memory);
+            if (budget_) budget_->release(bytes);
+            return nullptr;
+        }
+    } while (!allocated_.compare_exchange_weak(index, index + 1));
+
+    pool_block_t* block = new (memory) pool_block_t;
+    block->refcount  = 0;
+    block->next_free = 0;
+    block->index     = index;
+    block->pool      = this;
+    blocks_[index]   = block;
+    return block;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pop_free() - Pops a block off the free list
+//=============================================================================
+pool_block_t* CBlockPool::pop_free()
+{
+    uint64_t head = free_head_.load(memory_order_acquire);
+
+    while (true)
+    {
+        uint32_t first = (uint32_t)head;
+        if (first == 0) return nullptr;
+
+        pool_block_t* block = blocks_[first - 1];
+        uint64_t new_head = ((head >> 32) + 1) << 32 | block->next_free.load(memory_order_relaxed);
+        if (free_head_.compare_exchange_weak(head, new_head, memory_order_acq_rel, memory_order_acquire))
+            return block;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// release() - Pushes a block onto the free list
+//=============================================================================
+void CBlockPool::release(pool_block_t* block)
+{
+    uint64_t head = free_head_.load(memory_order_relaxed);
+    uint64_t new_head;
+
+    do
+    {
+        block->next_free.store((uint32_t)head, memory_order_relaxed);
+        new_head = ((head >> 32) + 1) << 32 | (block->index + 1);
+    } while (!free_head_.compare_exchange_weak(head, new_head, memory_order_release, memory_order_relaxed));
+
+    in_use_.fetch_sub(1, memory_order_relaxed);
+}
+//=============================================================================
+
+
+//=============================================================================
+// acquire() - Fetches a free block, allocating or waiting for one if need be
+//=============================================================================
+CBlockRef CBlockPool::acquire()
+{
+    pool_block_t* block;
+    int attempts = 0;
+    chrono::steady_clock::time_point start;
+
+    // Take a free block if there is one, or make a new one if we're allowed.
+    // Otherwise every block is in use, and we wait for a consumer to 
+    // release one.
+    while ((block = pop_free()) == nullptr && (block = allocate()) == nullptr)
+    {
+        if (attempts == 0) start = chrono::steady_clock::now();
+
+        if (++attempts < 64)
+            this_thread::yield();
+        else
+            this_thread::sleep_for(chrono::microseconds(50));
+    }
+
+    // If we had to wait, record how long for
+    if (attempts)
+    {
+        auto elapsed = chrono::steady_clock::now() - start;
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+        throttle_events_.fetch_add(1, memory_order_relaxed);
+        throttled_ns_.fetch_add(ns, memory_order_relaxed);
+        if (budget_) budget_->record_throttle(ns);
+        PCAPREADER_PROBE1(pool_stall, ns);
+    }
+
+    in_use_.fetch_add(1, memory_order_relaxed);
+    block->refcount.store(1, memory_order_relaxed);
+    return CBlockRef(block);
+}
+//=============================================================================
@@ -0,0 +1,189 @@
+//=============================================================================
+// block_pool.h - A pool of reference-counted memory blocks, and packets 
+//                that keep the block they live in alive.
+//
+// When CPcapReader is given a CBlockPool, it reads the file into blocks 
+// from the pool.  A shared_packet_t handed out by the reader holds a 
+// reference to its block, so it can be passed to another thread without 
+// copying the packet.  When the last reference to a block is dropped, the
+// block goes back on the pool's free list, ready to be read into again.
+//
+// The free list is a lock-free stack, so releasing a block from a consumer
+// thread never blocks the reader.
+//
+// If the pool is given a CMemoryBudget, each new block is charged against
+// it.  When the budget won't stretch to another block, acquire() waits for
+// a block to be released, which throttles the reader.
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+#include "packet_batch.h"
+#include "memory_budget.h"
+
+class CBlockPool;
+
+
+//=============================================================================
+// The header of a block.  The block's data immediately follows it.
+//=============================================================================
+struct pool_block_t
+{
+    // The number of CBlockRefs that refer to this block
+    std::atomic<uint32_t>   refcount;
+
+    // While on the free list, the index + 1 of the next free block (0 = none)
+    std::atomic<uint32_t>   next_free;
+
+    // This block's position in the pool
+    uint32_t                index;
+
+    // The pool this block belongs to
+    CBlockPool*             pool;
+
+    uint8_t* data() {return (uint8_t*)(this + 1);}
+};
+//=============================================================================
+
+
+//=============================================================================
+// A counted reference to a block.  The block returns to its pool when the
+// last reference to it goes away.
+//=============================================================================
+class CBlockRef
+{
+public:
+
+    CBlockRef() {block_ = nullptr;}
+    explicit CBlockRef(pool_block_t* block) {block_ = block;}
+    CBlockRef(const CBlockRef& rhs) {block_ = rhs.block_; add_ref();}
+    CBlockRef(CBlockRef&& rhs) noexcept {block_ = rhs.block_; rhs.block_ = nullptr;}
+    ~CBlockRef() {reset();}
+
+    CBlockRef& operator=(const CBlockRef& rhs)
+    {
+        if (block_ != rhs.block_) {reset(); block_ = rhs.block_; add_ref();}
+        return *this;
+    }
+
+    CBlockRef& operator=(CBlockRef&& rhs) noexcept
+    {
+        if (this != &rhs) {reset(); block_ = rhs.block_; rhs.block_ = nullptr;}
+        return *this;
+    }
+
+    // Drops this reference
+    inline void reset();
+
+    // True if this is the only reference to the block
+    bool    unique() const {return block_ && block_->refcount.load(std::memory_order_acquire) == 1;}
+
+    uint8_t* data() const {return block_ ? block_->data() : nullptr;}
+    explicit operator bool() const {return block_ != nullptr;}
+
+protected:
+
+    void    add_ref() {if (block_) block_->refcount.fetch_add(1, std::memory_order_relaxed);}
+
+    pool_block_t*   block_;
+};
+//=============================================================================
+
+
+//=============================================================================
+// A packet that keeps the block it lives in from being reused
+//=============================================================================
+struct shared_packet_t
+{
+    packet_view_t   view;
+    CBlockRef       block;
+};
+//=============================================================================
+
+
+//=============================================================================
+// The pool of blocks
+//=============================================================================
+class CBlockPool
+{
+public:
+
+    // Blocks are "block_size" bytes, and are allocated as needed up to a 
+    // limit of "max_blocks", or for as long as "budget" has room for them.
+    // Will throw std::runtime_error on failure.
+    CBlockPool(size_t block_size = 1024 * 1024 + 64, uint32_t max_blocks = 64,
+               CMemoryBudget* budget = nullptr);
+
+    // Frees every block.  There must be no references to any of them left.
+    ~CBlockPool();
+
+    // Fetches a block from the free list, allocating a new one if the free
+    // list is empty and we haven't reached "max_blocks".  Otherwise waits 
+    // for a block to be released.
+    // Will throw std::bad_alloc if a new block can't be allocated.  The pool
+    // is left as it was, so acquire() can be tried again.
+    CBlockRef   acquire();
+
+    // Returns a block to the free list.  Called when its last reference 
+    // is dropped.
+    void        release(pool_block_t* block);
+
+    // The size of each block
+    size_t      block_size() const {return block_size_;}
+
+    // The number of blocks allocated so far, and the number in use
+    uint32_t    blocks_allocated() const {return allocated_.load();}
+    uint32_t    blocks_in_use() const {return in_use_.load();}
+
+    // The number of times acquire() had to wait for a block to be released,
+    // and the total time spent waiting
+    uint64_t    throttle_events() const {return throttle_events_.load();}
+    uint64_t    throttled_ns() const {return throttled_ns_.load();}
+
+protected:
+
+    // Pops a block off the free list, or returns nullptr if it's empty
+    pool_block_t* pop_free();
+
+    // Allocates a new block, or returns nullptr if we're at the limit.
+    // Will throw std::bad_alloc if the memory can't be had, leaving the 
+    // pool and the budget as they were.
+    pool_block_t* allocate();
+
+    // The number of bytes of memory each block occupies
+    size_t      footprint() const {return (sizeof(pool_block_t) + block_size_ + 63) & ~size_t(63);}
+
+    size_t      block_size_;
+    uint32_t    max_blocks_;
+    CMemoryBudget* budget_;
+
+    // Every block we've allocated, by index
+    std::vector<pool_block_t*> blocks_;
+
+    // The top of the free list: the low 32 bits are the index + 1 of the 
+    // first free block, and the high 32 bits are a counter that changes on
+    // every push and pop, so that a stale compare-and-swap can't succeed.
+    std::atomic<uint64_t> free_head_;
+
+    std::atomic<uint32_t> allocated_;
+    std::atomic<uint32_t> in_use_;
+
+    std::atomic<uint64_t> throttle_events_;
+    std::atomic<uint64_t> throttled_ns_;
+};
+//=============================================================================
+
+
+//=============================================================================
+// reset() - Drops a reference to a block, returning the block to its pool
+//           if this was the last one
+//=============================================================================
+inline void CBlockRef::reset()
+{
+    if (block_ && block_->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        block_->pool->release(block_);
+    block_ = nullptr;
+}
+//=============================================================================
@@ -0,0 +1,97 @@
+//=============================================================================
+// budget_queue.h - A queue between pipeline stages whose contents are 
+//                  charged against a CMemoryBudget.
+//
+// push() reserves "item_cost" bytes for each item, and so waits when the
+// budget is exhausted; pop() gives them back.  A stage that falls behind 
+// therefore throttles the stages feeding it.  Once the queue is closed,
+// push() refuses new items, including one that is waiting for the budget.
+//=============================================================================
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "memory_budget.h"
+
+
+template <class T> class CBudgetQueue
+{
+public:
+
+    CBudgetQueue(CMemoryBudget& budget, size_t item_cost = sizeof(T)) 
+        : budget_(budget) {item_cost_ = item_cost; closed_ = false;}
+
+    // Releases the budget held by anything left in the queue
+    ~CBudgetQueue() {budget_.release(items_.size() * item_cost_);}
+
+    // Adds an item, waiting for room in the budget if need be.  Returns 
+    // false, and drops the item, if the queue has been closed.
+    bool    push(T item)
+    {
+        if (!budget_.reserve_unless(item_cost_, [this]{return is_closed();})) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!closed_)
+            {
+                items_.push_back(std::move(item));
+                ready_.notify_one();
+                return true;
+            }
+        }
+
+        // We were closed while we waited for the budget
+        budget_.release(item_cost_);
+        return false;
+    }
+
+    // Waits for an item and removes it.  Returns false once the queue has 
+    // been closed and emptied.
+    bool    pop(T* item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [&]{return closed_ || !items_.empty();});
+            if (items_.empty()) return false;
+            *item = std::move(items_.front());
+            items_.pop_front();
+        }
+        budget_.release(item_cost_);
+        return true;
+    }
+
+    // Tells the consumer that no more items are coming, and stops any 
+    // push() that is waiting for the budget
+    void    close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            ready_.notify_all();
+        }
+        budget_.wake();
+    }
+
+    // Has close() been called?
+    bool    is_closed()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_;
+    }
+
+    // The number of items waiting in the queue
+    size_t  depth()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+protected:
+
+    CMemoryBudget&          budget_;
+    size_t                  item_cost_;
+    bool                    closed_;
+    std::deque<T>           items_;
+    std::mutex              mutex_;
+    std::condition_variable ready_;
+};
+//=============================================================================
@@ -0,0 +1,21 @@
+//=============================================================================
+// cpu_dispatch.cpp - Runtime selection of the best instruction set
+//=============================================================================
+#include "cpu_dispatch.h"
+
+
+//=============================================================================
+// cpu_dispatch_level() - Reports which of the cloned kernels the loader 
+//                        picked.  This follows the same order of preference.
+//=============================================================================
+const char* cpu_dispatch_level()
+{
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && !defined(PCAPREADER_NO_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return "avx512f";
+    if (__builtin_cpu_supports("avx2"))    return "avx2";
+    if (__builtin_cpu_supports("sse4.2"))  return "sse4.2";
+#endif
+    return "default";
+}
+//=============================================================================
@@ -0,0 +1,41 @@
+//=============================================================================
+// cpu_dispatch.h - Runtime selection of the best instruction set for the 
+//                  library's batch kernels.
+//
+// One binary gets deployed to machines with different CPUs, and is built
+// for the baseline x86-64 instruction set.  A kernel marked with
+// PCAPREADER_CPU_CLONES is compiled several times over, once for each of 
+// the instruction sets below, and the dynamic loader picks the best one the
+// CPU supports (via cpuid) when the program starts.  After that, a call 
+// costs the same as any call through a function pointer.
+//
+// Mark only out-of-line functions in .cpp files, whose loops the compiler
+// can vectorize.  Build with -DPCAPREADER_NO_DISPATCH to compile just the
+// baseline copy.
+//=============================================================================
+#pragma once
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && !defined(PCAPREADER_NO_DISPATCH)
+#define PCAPREADER_CPU_CLONES __attribute__((target_clones("default", "sse4.2", "avx2", "avx512f")))
+#else
+#define PCAPREADER_CPU_CLONES
+#endif
+
+// The vectorizer builds a vector from loads that are a run-time stride apart
+// one element at a time, and its cost model judges that a loss.  Where the
+// loads miss the cache, it isn't: the vector loop has more of them in flight.
+// Mark such a kernel with PCAPREADER_STRIDED_VECTORIZE as well.
+#if defined(__GNUC__) && !defined(__clang__)
+#define PCAPREADER_STRIDED_VECTORIZE __attribute__((optimize("vect-cost-model=unlimited")))
+#else
+#define PCAPREADER_STRIDED_VECTORIZE
+#endif
+
+
+//=============================================================================
+// cpu_dispatch_level() - Returns the instruction set that the kernels are 
+//                        running with on this machine: "avx512f", "avx2", 
+//                        "sse4.2" or "default"
+//=============================================================================
+const char* cpu_dispatch_level();
+//=============================================================================
@@ -0,0 +1,126 @@
+//=============================================================================
+// for_each_packet.h - Calls a function for every packet from a reader, with
+//                     the function inlined into the read loop.
+//
+//     for_each_packet(reader, [&](const packet_view_t& packet) 
+//     {
+//         ...
+//     });
+//
+//     for_each_packet<parse_depth_t::udp>(reader, 
+//         [&](const packet_view_t& packet, const eth_header_t& header)
+//     {
+//         ...
+//     });
+//
+// With a parse depth other than parse_depth_t::none, each packet's headers
+// are parsed down to that depth and handed to the function as well.
+//
+// If the function returns a bool, returning false stops the loop early.
+// for_each_packet() returns the number of packets that were visited.
+//
+// Given a CStageLatency, the loop also records how long each packet spends
+// being read, parsed and consumed (see stage_latency.h).
+//=============================================================================
+#pragma once
+#include <type_traits>
+#include "pcap_reader.h"
+#include "packet_parse.h"
+#include "stage_latency.h"
+
+
+//=============================================================================
+// invoke_visitor() - Calls the caller's function.  Returns false if the 
+//                    function asked to stop.
+//=============================================================================
+template <class F, class... Args>
+inline bool invoke_visitor(F& f, const Args&... args)
+{
+    if constexpr (std::is_same<decltype(f(args...)), bool>::value)
+        return f(args...);
+    else
+        f(args...);
+    return true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// visit_packet() - Hands one packet to the caller's function.  Returns false
+//                  if the function asked to stop.
+//=============================================================================
+template <parse_depth_t Depth, class F>
+inline bool visit_packet(const packet_view_t& packet, F& f, CStageLatency* latency = nullptr)
+{
+    bool keep_going;
+
+    if constexpr (Depth == parse_depth_t::none)
+    {
+        keep_going = invoke_visitor(f, packet);
+    }
+    else
+    {
+        eth_header_t header;
+        parse_headers<Depth>(packet.data, &header);
+        latency_mark(latency, stage_t::parse);
+        keep_going = invoke_visitor(f, packet, header);
+    }
+
+    latency_mark(latency, stage_t::consume);
+    return keep_going;
+}
+//=============================================================================
+
+
+//=============================================================================
+// for_each_packet() - Calls "f" for every remaining packet in a PCAP file
+//=============================================================================
+template <parse_depth_t Depth = parse_depth_t::none, class F>
+inline size_t for_each_packet(CPcapReader& reader, F&& f, CStageLatency* latency = nullptr)
+{
+    size_t count = 0;
+    packet_view_t packet;
+
+    latency_start(latency);
+    while (reader.get_next_view(&packet))
+    {
+        ++count;
+        latency_mark(latency, stage_t::read);
+        if (!visit_packet<Depth>(packet, f, latency)) break;
+        latency_start(latency);
+    }
+
+    return count;
+}
+//=============================================================================
+
+
+//=============================================================================
+// for_each_packet() - Calls "f" for every packet from any packet source, a
+//                     batch at a time.  The packets in a batch all become
+//                     available at once, so their latencies are measured 
+//                     from the arrival of the batch.
+//=============================================================================
+template <parse_depth_t Depth = parse_depth_t::none, class F>
+inline size_t for_each_packet(CPacketSource& source, F&& f, CStageLatency* latency = nullptr)
+{
+    size_t count = 0;
+    CPacketBatch batch;
+
+    latency_start(latency);
+    while (source.get_next_batch(batch))
+    {
+        latency_mark(latency, stage_t::read);
+
+        for (const packet_view_t& packet : batch)
+        {
+            ++count;
+            if (!visit_packet<Depth>(packet, f, latency)) return count;
+        }
+
+        latency_start(latency);
+    }
+
+    return count;
+}
+//=============================================================================
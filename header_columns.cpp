@@ -0,0 +1,99 @@
+//=============================================================================
+// header_columns.cpp - The parsed headers of a batch of packets, stored as
+//                      columns
+//=============================================================================
+#include "header_columns.h"
+#include "packet_parse.h"
+
+using namespace std;
+
+
+//=============================================================================
+// resize() - Makes room in every column for "count" packets.  The columns 
+//            only ever grow, so after the first few batches this costs 
+//            nothing.
+//=============================================================================
+void CHeaderColumns::resize(size_t count)
+{
+    count_ = count;
+    if (layers.size() >= count) return;
+
+    layers        .resize(count);
+    ts_seconds    .resize(count);
+    ts_nanoseconds.resize(count);
+    length        .resize(count);
+    data_offset   .resize(count);
+    eth_type      .resize(count);
+    ip4_protocol  .resize(count);
+    ip4_src_ip    .resize(count);
+    ip4_dst_ip    .resize(count);
+    udp_src_port  .resize(count);
+    udp_dst_port  .resize(count);
+    udp_length    .resize(count);
+    rdmx_target   .resize(count);
+}
+//=============================================================================
+
+
+//=============================================================================
+// scatter() - Parses the headers of every packet in the batch and scatters 
+//             their fields into the columns.  Parsing branches on what 
+//             each packet holds, so the loop doesn't vectorize, and there's
+//             nothing for cpu_dispatch.h to gain by compiling it for more
+//             than one instruction set.
+//=============================================================================
+static void scatter(const CPacketBatch& batch, const uint8_t* data_base, CHeaderColumns* out)
+{
+    size_t count = batch.size();
+    eth_header_compact_t header;
+    for (size_t i=0; i<count; ++i)
+    {
+        const packet_view_t& packet = batch[i];
+        parse_compact<parse_depth_t::rdmx>(packet.data, &header);
+
+        out->layers[i]         = header.layers;
+        out->ts_seconds[i]     = packet.ts_seconds;
+        out->ts_nanoseconds[i] = packet.ts_nanoseconds;
+        out->length[i]         = packet.length;
+        out->data_offset[i]    = packet.data - data_base;
+        out->eth_type[i]       = header.eth_type;
+        out->ip4_protocol[i]   = header.ip4_protocol;
+        out->ip4_src_ip[i]     = header.ip4_src_ip;
+        out->ip4_dst_ip[i]     = header.ip4_dst_ip;
+        out->udp_src_port[i]   = header.udp_src_port;
+        out->udp_dst_port[i]   = header.udp_dst_port;
+        out->udp_length[i]     = header.udp_length;
+        out->rdmx_target[i]    = header.rdmx_target;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// decode() - Parses the headers of every packet in the batch into the 
+//            columns
+//=============================================================================
+void CHeaderColumns::decode(const CPacketBatch& batch)
+{
+    size_t count = batch.size();
+    resize(count);
+
+    // Find the span of memory that holds all of the packet data
+    data_base_ = nullptr;
+    data_span_ = 0;
+    if (count == 0) return;
+
+    const uint8_t* lowest  = batch[0].data;
+    const uint8_t* highest = batch[0].data + batch[0].length;
+    for (const packet_view_t& packet : batch)
+    {
+        if (packet.data < lowest) lowest = packet.data;
+        if (packet.data + packet.length > highest) highest = packet.data + packet.length;
+    }
+    data_base_ = lowest;
+    data_span_ = highest - lowest;
+
+    // Parse each packet and scatter its fields into the columns
+    scatter(batch, data_base_, this);
+}
+//=============================================================================
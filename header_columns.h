@@ -0,0 +1,60 @@
+//=============================================================================
+// header_columns.h - The parsed headers of a batch of packets, stored as
+//                    columns (one array per field) rather than as an array
+//                    of structures.
+//
+// Columnar storage is what vectorized consumers want: NumPy, for instance,
+// can wrap each column as an array without copying it.  The packet data 
+// itself isn't copied either; each packet is described by its offset from
+// data_base(), which points into the buffer of the source that produced 
+// the batch.  The columns and the data remain valid until the source is 
+// next read from.
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "packet_batch.h"
+
+
+class CHeaderColumns
+{
+public:
+
+    // Parses the headers of every packet in the batch into the columns
+    void    decode(const CPacketBatch& batch);
+
+    // The number of packets described by the columns
+    size_t  size() const {return count_;}
+
+    // The data of packet "i" is "length[i]" bytes at data_base() + data_offset[i]
+    const uint8_t*  data_base() const {return data_base_;}
+    size_t          data_span() const {return data_span_;}
+
+    // How many layers of the packet we recognized: 0 = none, 1 = Ethernet,
+    // 2 = IPv4, 3 = UDP, 4 = RDMX
+    std::vector<uint8_t>    layers;
+
+    std::vector<uint32_t>   ts_seconds;
+    std::vector<uint32_t>   ts_nanoseconds;
+    std::vector<uint32_t>   length;
+    std::vector<uint32_t>   data_offset;
+
+    std::vector<uint16_t>   eth_type;
+    std::vector<uint8_t>    ip4_protocol;
+    std::vector<uint32_t>   ip4_src_ip;
+    std::vector<uint32_t>   ip4_dst_ip;
+    std::vector<uint16_t>   udp_src_port;
+    std::vector<uint16_t>   udp_dst_port;
+    std::vector<uint16_t>   udp_length;
+    std::vector<uint64_t>   rdmx_target;
+
+protected:
+
+    // Makes room in every column for "count" packets
+    void    resize(size_t count);
+
+    size_t          count_ = 0;
+    const uint8_t*  data_base_ = nullptr;
+    size_t          data_span_ = 0;
+};
+//=============================================================================
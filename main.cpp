@@ -1,17 +1,32 @@
 //=============================================================================
 // This is a simple demo of the CPcapReader class
+//
+// Run it as "readpcap -stats" to have it report the per-packet cost of 
+// reading and parsing, as measured by the hardware performance counters.
+// The packets aren't printed then, since printing them would cost far more
+// than reading them.
 //=============================================================================
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdexcept>
 #include "pcap_reader.h"
+#include "perf_counters.h"
 
 CPcapReader   reader;
 
+bool stats_mode = false;
+
+// In stats mode, the parsed headers are summed here so that the compiler
+// can't discard the parsing
+volatile uint64_t sink;
+
 void execute();
 
-int main()
+int main(int argc, char** argv)
 {
+    stats_mode = (argc > 1 && strcmp(argv[1], "-stats") == 0);
+
     try
     {
         execute();
@@ -26,13 +41,24 @@ int main()
 
 void execute()
 {
-    pcap_packet_t packet;
     eth_header_t header;
+    CPerfCounters counters;
+    uint64_t packets = 0;
 
     reader.open("chargen-udp.pcap");
 
-    while (reader.get_next_packet(&packet))
+    if (stats_mode && counters.open()) counters.start();
+
+    for (auto& packet : reader)
     {
+        if (stats_mode)
+        {
+            reader.parse_packet_headers(packet.data, &header);
+            sink += header.is_rdmx;
+            ++packets;
+            continue;
+        }
+
         printf("Timestamp        : %u seconds, %u ns\n", packet.ts_seconds, packet.ts_nanoseconds);
         printf("Data Length      : %u bytes\n", packet.length);
         printf("First three bytes: 0x%02X  0x%02X  0x%02X\n", packet.data[0], packet.data[1], packet.data[2]);
@@ -40,4 +66,11 @@ void execute()
         reader.parse_packet_headers(packet.data, &header);
         printf("\n");
     }
+
+    if (stats_mode)
+    {
+        counters.stop();
+        std::string summary = perf_summary(counters.read(), packets);
+        printf("Stats: %lu packets, %s\n", packets, summary.empty() ? "hardware counters unavailable" : summary.c_str());
+    }
 }
\ No newline at end of file
@@ -0,0 +1,199 @@
+//=============================================================================
+// memory_budget.cpp - A limit on the memory used by a set of reader 
+//                     pipelines
+//=============================================================================
+#include <chrono>
+#include <cstdio>
+#include <cstdarg>
+#include <stdexcept>
+#include "memory_budget.h"
+#include "usdt_probes.h"
+
+using namespace std;
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CMemoryBudget::CMemoryBudget(size_t limit_bytes)
+{
+    limit_           = limit_bytes;
+    used_            = 0;
+    peak_            = 0;
+    throttle_events_ = 0;
+    throttled_ns_    = 0;
+    waiters_         = 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// try_reserve() - Reserves memory if the budget has room for it
+//=============================================================================
+bool CMemoryBudget::try_reserve(size_t bytes)
+{
+    // These are sequentially consistent (the default) so that a release()
+    // can't miss a waiter that has just found the budget exhausted
+    size_t used = used_.load();
+    do
+    {
+        if (used + bytes > limit_) return false;
+    } while (!used_.compare_exchange_weak(used, used + bytes));
+
+    // Keep track of the high-water mark
+    size_t peak = peak_.load(memory_order_relaxed);
+    while (used + bytes > peak && !peak_.compare_exchange_weak(peak, used + bytes));
+
+    return true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// reserve() - Reserves memory, waiting for it if need be
+//=============================================================================
+void CMemoryBudget::reserve(size_t bytes)
+{
+    wait_to_reserve(bytes, chrono::steady_clock::time_point::max());
+}
+//=============================================================================
+
+
+//=============================================================================
+// reserve_for() - Reserves memory, waiting no longer than "timeout" for it
+//=============================================================================
+bool CMemoryBudget::reserve_for(size_t bytes, chrono::milliseconds timeout)
+{
+    return wait_to_reserve(bytes, chrono::steady_clock::now() + timeout);
+}
+//=============================================================================
+
+
+//=============================================================================
+// reserve_unless() - Reserves memory, waiting for it until "give_up" says to
+//                    stop
+//=============================================================================
+bool CMemoryBudget::reserve_unless(size_t bytes, const function<bool()>& give_up)
+{
+    return wait_to_reserve(bytes, chrono::steady_clock::time_point::max(), give_up);
+}
+//=============================================================================
+
+
+//=============================================================================
+// wake() - Wakes the waiters so that they check whether to give up
+//=============================================================================
+void CMemoryBudget::wake()
+{
+    lock_guard<mutex> lock(mutex_);
+    released_.notify_all();
+}
+//=============================================================================
+
+
+//=============================================================================
+// wait_to_reserve() - Reserves memory, waiting until "deadline" for it if 
+//                     need be, or until "give_up" returns true.  A deadline
+//                     of time_point::max() waits for as long as it takes.
+//
+// Returns false if the memory didn't become available in time
+//=============================================================================
+bool CMemoryBudget::wait_to_reserve(size_t bytes, chrono::steady_clock::time_point deadline,
+                                    const function<bool()>& give_up)
+{
+    // If we'd never be able to satisfy this, waiting won't help
+    if (bytes > limit_)
+        throwRuntime("Reservation of %zu bytes exceeds memory budget of %zu", bytes, limit_);
+
+    // This is the usual case
+    if (try_reserve(bytes)) return true;
+
+    // Otherwise, wait for someone to release some memory
+    bool reserved;
+    auto start = chrono::steady_clock::now();
+    {
+        unique_lock<mutex> lock(mutex_);
+        ++waiters_;
+        while (!(reserved = try_reserve(bytes)))
+        {
+            // This is checked under our mutex, so a wake() that follows
+            // whatever makes it true can't be missed
+            if (give_up && give_up()) break;
+
+            if (deadline == chrono::steady_clock::time_point::max())
+                released_.wait(lock);
+            else if (released_.wait_until(lock, deadline) == cv_status::timeout)
+            {
+                reserved = try_reserve(bytes);
+                break;
+            }
+        }
+        --waiters_;
+    }
+    auto elapsed = chrono::steady_clock::now() - start;
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+    record_throttle(ns);
+    PCAPREADER_PROBE2(budget_stall, bytes, ns);
+    return reserved;
+}
+//=============================================================================
+
+
+//=============================================================================
+// release() - Gives back memory, and wakes anyone waiting for it
+//=============================================================================
+void CMemoryBudget::release(size_t bytes)
+{
+    used_.fetch_sub(bytes);
+
+    // Only take the lock if there's somebody to wake
+    if (waiters_.load() > 0)
+    {
+        lock_guard<mutex> lock(mutex_);
+        released_.notify_all();
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// record_throttle() - Adds to the throttling counters
+//=============================================================================
+void CMemoryBudget::record_throttle(uint64_t nanoseconds)
+{
+    throttle_events_.fetch_add(1, memory_order_relaxed);
+    throttled_ns_.fetch_add(nanoseconds, memory_order_relaxed);
+}
+//=============================================================================
+
+
+//=============================================================================
+// stats() - Fetches the counters
+//=============================================================================
+memory_budget_stats_t CMemoryBudget::stats() const
+{
+    memory_budget_stats_t result;
+    result.limit           = limit_;
+    result.used            = used_.load(memory_order_relaxed);
+    result.peak            = peak_.load(memory_order_relaxed);
+    result.throttle_events = throttle_events_.load(memory_order_relaxed);
+    result.throttled_ns    = throttled_ns_.load(memory_order_relaxed);
+    return result;
+}
+//=============================================================================
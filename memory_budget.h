@@ -0,0 +1,96 @@
+//=============================================================================
+// memory_budget.h - A limit on the memory used by a set of reader pipelines,
+//                   shared between reader buffers, queues and analyzer state.
+//
+// Anything that wants memory reserves it from the budget first.  When the
+// budget is exhausted, reserve() waits until something else releases 
+// memory.  That's the backpressure: a reader that has got ahead of its 
+// analyzers stalls until they catch up, instead of buffering without bound.
+//
+// The time spent waiting is recorded, so it can be seen how often, and for
+// how long, jobs are being throttled.
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+
+//=============================================================================
+// A snapshot of a memory budget's counters
+//=============================================================================
+struct memory_budget_stats_t
+{
+    size_t      limit;
+    size_t      used;
+    size_t      peak;
+
+    // The number of reservations that had to wait, and the total time
+    // spent waiting
+    uint64_t    throttle_events;
+    uint64_t    throttled_ns;
+};
+//=============================================================================
+
+
+class CMemoryBudget
+{
+public:
+
+    explicit CMemoryBudget(size_t limit_bytes);
+
+    // Reserves memory, waiting for it to become available if need be.
+    // Will throw std::runtime_error if "bytes" is more than the whole budget.
+    void    reserve(size_t bytes);
+
+    // The same as reserve(), except that it waits no longer than "timeout".
+    // Returns false if the memory didn't become available in that time.
+    bool    reserve_for(size_t bytes, std::chrono::milliseconds timeout);
+
+    // The same as reserve(), except that it stops waiting once "give_up"
+    // returns true.  "give_up" is checked before each wait, and again 
+    // whenever wake() is called.  Returns false if it gave up.
+    bool    reserve_unless(size_t bytes, const std::function<bool()>& give_up);
+
+    // Wakes everything waiting in reserve_unless(), so that they check 
+    // whether to give up
+    void    wake();
+
+    // Reserves memory if it's available right now.  Returns false if not.
+    bool    try_reserve(size_t bytes);
+
+    // Gives back memory that was reserved
+    void    release(size_t bytes);
+
+    // Adds to the throttling counters.  This is for callers that wait for
+    // memory some other way, such as a block pool waiting for a block to 
+    // be released when the budget won't stretch to another.
+    void    record_throttle(uint64_t nanoseconds);
+
+    // Fetches the counters
+    memory_budget_stats_t stats() const;
+
+protected:
+
+    // Waits until "bytes" can be reserved, until "deadline", or until 
+    // "give_up" (if there is one) returns true
+    bool    wait_to_reserve(size_t bytes, std::chrono::steady_clock::time_point deadline,
+                            const std::function<bool()>& give_up = nullptr);
+
+    size_t              limit_;
+    std::atomic<size_t> used_;
+    std::atomic<size_t> peak_;
+
+    std::atomic<uint64_t> throttle_events_;
+    std::atomic<uint64_t> throttled_ns_;
+
+    // reserve() sleeps on this when the budget is exhausted
+    std::mutex              mutex_;
+    std::condition_variable released_;
+    std::atomic<int>        waiters_;
+};
+//=============================================================================
@@ -0,0 +1,401 @@
+//=============================================================================
+// metrics_exporter.cpp - Publishes metrics in the Prometheus text format
+//=============================================================================
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include <stdexcept>
+#include "metrics_exporter.h"
+#include "pcap_set_reader.h"
+#include "udp_source.h"
+
+using namespace std;
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// counter() / gauge() - Add a sample of a metric
+//=============================================================================
+void CMetricsWriter::counter(const string& name, const string& help, double value, const string& labels)
+{
+    add(name, help, "counter", value, labels);
+}
+
+void CMetricsWriter::gauge(const string& name, const string& help, double value, const string& labels)
+{
+    add(name, help, "gauge", value, labels);
+}
+//=============================================================================
+
+
+//=============================================================================
+// add() - Adds a sample to the family it belongs to
+//=============================================================================
+void CMetricsWriter::add(const string& name, const string& help, const char* type,
+                         double value, const string& labels)
+{
+    for (family_t& family : families_)
+    {
+        if (family.name == name)
+        {
+            family.samples.push_back({labels, value});
+            return;
+        }
+    }
+
+    families_.push_back({name, help, type, {{labels, value}}});
+}
+//=============================================================================
+
+
+//=============================================================================
+// text() - Renders the snapshot in the Prometheus text format
+//=============================================================================
+string CMetricsWriter::text() const
+{
+    string result;
+    char value[64];
+
+    for (const family_t& family : families_)
+    {
+        result += "# HELP " + family.name + " " + family.help + "\n";
+        result += "# TYPE " + family.name + " " + family.type + "\n";
+
+        for (auto& sample : family.samples)
+        {
+            snprintf(value, sizeof(value), " %.17g\n", sample.second);
+            result += family.name;
+            if (!sample.first.empty()) result += "{" + sample.first + "}";
+            result += value;
+        }
+    }
+
+    return result;
+}
+//=============================================================================
+
+
+//=============================================================================
+// metric_label() - Builds a label, escaping the value
+//=============================================================================
+string metric_label(const string& name, const string& value)
+{
+    string result = name + "=\"";
+    for (char c : value)
+    {
+        if      (c == '\\') result += "\\\\";
+        else if (c == '"' ) result += "\\\"";
+        else if (c == '\n') result += "\\n";
+        else result += c;
+    }
+    return result + "\"";
+}
+//=============================================================================
+
+
+//=============================================================================
+// add_metrics() - Adds the counters of a reader
+//=============================================================================
+void add_metrics(CMetricsWriter& writer, const pcap_reader_stats_t& stats, const string& labels)
+{
+    writer.counter("pcapreader_packets_total",              "Packets read", stats.packets, labels);
+    writer.counter("pcapreader_bytes_total",                "Bytes of packet data read", stats.bytes, labels);
+    writer.counter("pcapreader_records_corrupt_total",      "Records with an unbelievable length", stats.records_corrupt, labels);
+    writer.counter("pcapreader_records_skipped_total",      "Corrupt records skipped", stats.records_skipped, labels);
+    writer.counter("pcapreader_bytes_skipped_total",        "Bytes dropped while skipping corrupt records", stats.bytes_skipped, labels);
+    writer.counter("pcapreader_read_calls_total",           "Reads from the file", stats.read_calls, labels);
+    writer.counter("pcapreader_bytes_read_total",           "Bytes read from the file", stats.bytes_read, labels);
+    writer.counter("pcapreader_refills_total",              "Block buffer refills", stats.refills, labels);
+    writer.counter("pcapreader_io_blocked_seconds_total",   "Time spent waiting for block refills", stats.io_blocked_ns / 1e9, labels);
+    writer.counter("pcapreader_memcpy_bytes_avoided_total", "Packet bytes handed out without being copied", stats.memcpy_bytes_avoided, labels);
+}
+//=============================================================================
+
+
+//=============================================================================
+// add_metrics() - Adds the state of a memory budget
+//=============================================================================
+void add_metrics(CMetricsWriter& writer, const memory_budget_stats_t& stats, const string& labels)
+{
+    writer.gauge  ("pcapreader_memory_limit_bytes",             "Memory budget limit", stats.limit, labels);
+    writer.gauge  ("pcapreader_memory_used_bytes",              "Memory budget in use", stats.used, labels);
+    writer.gauge  ("pcapreader_memory_peak_bytes",              "Most memory budget ever in use", stats.peak, labels);
+    writer.counter("pcapreader_memory_throttle_events_total",   "Reservations that had to wait for memory", stats.throttle_events, labels);
+    writer.counter("pcapreader_memory_throttled_seconds_total", "Time spent waiting for memory", stats.throttled_ns / 1e9, labels);
+}
+//=============================================================================
+
+
+//=============================================================================
+// add_metrics() - Adds the counters of a file reader, and how far behind 
+//                 the end of the file it is
+//=============================================================================
+void add_metrics(CMetricsWriter& writer, const CPcapReader& reader, const string& labels)
+{
+    add_metrics(writer, reader.stats(), labels);
+    writer.gauge("pcapreader_lag_bytes", "Bytes written to the file but not yet read", reader.bytes_behind(), labels);
+}
+
+void add_metrics(CMetricsWriter& writer, CPcapSetReader& reader, const string& labels)
+{
+    add_metrics(writer, reader.stats(), labels);
+    writer.gauge("pcapreader_lag_bytes", "Bytes written to the file but not yet read", reader.bytes_behind(), labels);
+}
+//=============================================================================
+
+
+//=============================================================================
+// add_metrics() - Adds the drop count of a UDP source
+//=============================================================================
+void add_metrics(CMetricsWriter& writer, const CUdpSource& source, const string& labels)
+{
+    writer.counter("pcapreader_udp_drops_total", "Datagrams the kernel dropped for lack of buffer space", source.drops(), labels);
+}
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CMetricsExporter::CMetricsExporter()
+{
+    listen_fd_     = -1;
+    interval_ms_   = 10000;
+    stop_          = false;
+    previous_time_ = chrono::steady_clock::now();
+    collector_errors_ = 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// start() - Sets up the destination and starts the background thread
+//=============================================================================
+void CMetricsExporter::start(string destination, int interval_ms)
+{
+    stop();
+
+    interval_ms_ = (interval_ms > 0) ? interval_ms : 1;
+
+    // If the destination is a socket, start listening on it
+    if (destination.compare(0, 5, "unix:") == 0)
+    {
+        path_ = destination.substr(5);
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path_.empty() || path_.size() >= sizeof(addr.sun_path))
+            throwRuntime("Bad metrics socket path '%s'", path_.c_str());
+        strcpy(addr.sun_path, path_.c_str());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) throwRuntime("Can't create metrics socket: %s", strerror(errno));
+
+        // Remove the socket left behind by an earlier run
+        unlink(path_.c_str());
+
+        if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 8) < 0)
+        {
+            int error = errno;
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            throwRuntime("Can't listen on %s: %s", path_.c_str(), strerror(error));
+        }
+    }
+
+    // Otherwise, it's a file
+    else path_ = destination;
+
+    stop_ = false;
+    thread_ = thread(&CMetricsExporter::run, this);
+}
+//=============================================================================
+
+
+//=============================================================================
+// stop() - Stops the background thread
+//=============================================================================
+void CMetricsExporter::stop()
+{
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+
+    if (listen_fd_ >= 0)
+    {
+        ::close(listen_fd_);
+        unlink(path_.c_str());
+        listen_fd_ = -1;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// snapshot() - Runs the collectors, then adds the rate of every counter
+//=============================================================================
+string CMetricsExporter::snapshot()
+{
+    lock_guard<mutex> lock(snapshot_mutex_);
+
+    // Run the collectors.  One that fails is counted, and doesn't keep the
+    // others from being published.
+    CMetricsWriter writer;
+    for (auto& collector : collectors_)
+    {
+        try
+        {
+            collector(writer);
+        }
+        catch(const exception&)
+        {
+            ++collector_errors_;
+        }
+    }
+
+    writer.counter("pcapreader_exporter_collector_errors_total", "Collectors that threw an exception", 
+                   collector_errors_);
+
+    auto now = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(now - previous_time_).count();
+    bool have_previous = !previous_.empty();
+
+    // Work out the rates.  A counter we haven't seen before, or one that has
+    // gone backwards (say because a reader was replaced), has no rate yet.
+    map<string, double> current;
+    vector<CMetricsWriter::family_t> rates;
+    for (auto& family : writer.families_)
+    {
+        if (family.type != "counter") continue;
+
+        string name = family.name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, "_total") == 0) name.resize(name.size() - 6);
+        CMetricsWriter::family_t rate = {name + "_per_second", "Rate of " + family.name, "gauge", {}};
+
+        for (auto& sample : family.samples)
+        {
+            string key = family.name + "{" + sample.first + "}";
+            current[key] = sample.second;
+
+            auto it = previous_.find(key);
+            if (have_previous && it != previous_.end() && sample.second >= it->second && seconds > 0)
+                rate.samples.push_back({sample.first, (sample.second - it->second) / seconds});
+        }
+
+        if (!rate.samples.empty()) rates.push_back(rate);
+    }
+
+    for (auto& rate : rates) writer.families_.push_back(rate);
+
+    previous_.swap(current);
+    previous_time_ = now;
+    return writer.text();
+}
+//=============================================================================
+
+
+//=============================================================================
+// run() - The background thread.  It takes a snapshot every interval, and
+//         in between, hands the latest one to anyone who connects.
+//=============================================================================
+void CMetricsExporter::run()
+{
+    auto next = chrono::steady_clock::now();
+    string text;
+
+    while (!stop_)
+    {
+        auto now = chrono::steady_clock::now();
+        if (now >= next)
+        {
+            // If we can't even build a snapshot (say we're out of memory),
+            // keep serving the last one and try again next interval
+            try
+            {
+                text = snapshot();
+                if (listen_fd_ < 0) write_file(text);
+            }
+            catch(const exception&)
+            {
+            }
+            next = now + chrono::milliseconds(interval_ms_);
+        }
+
+        // Wait until the next snapshot is due, or for a connection, waking
+        // up regularly to see if we've been stopped
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(next - chrono::steady_clock::now()).count();
+        int timeout = (remaining < 0) ? 0 : (remaining > 100) ? 100 : remaining;
+
+        pollfd pfd = {listen_fd_, POLLIN, 0};
+        if (poll(&pfd, listen_fd_ >= 0 ? 1 : 0, timeout) > 0) serve_clients(text);
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// write_file() - Replaces the destination file with a snapshot.  We write a
+//                temporary file and rename it, so a reader never sees a 
+//                half-written snapshot.
+//=============================================================================
+void CMetricsExporter::write_file(const string& text)
+{
+    string temp = path_ + ".tmp";
+
+    FILE* ofile = fopen(temp.c_str(), "w");
+    if (ofile == nullptr) return;
+
+    bool ok = fwrite(text.data(), 1, text.size(), ofile) == text.size();
+    ok = (fclose(ofile) == 0) && ok;
+
+    if (ok) rename(temp.c_str(), path_.c_str());
+    else unlink(temp.c_str());
+}
+//=============================================================================
+
+
+//=============================================================================
+// serve_clients() - Sends the snapshot to every waiting connection
+//=============================================================================
+void CMetricsExporter::serve_clients(const string& text)
+{
+    int fd;
+    while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC)) >= 0)
+    {
+        // Don't let a client that isn't reading hold us up for long
+        timeval tv = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        for (size_t sent = 0; sent < text.size(); )
+        {
+            ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            sent += n;
+        }
+
+        ::close(fd);
+    }
+}
+//=============================================================================
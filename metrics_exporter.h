@@ -0,0 +1,165 @@
+//=============================================================================
+// metrics_exporter.h - Periodically publishes metrics in the Prometheus text
+//                      format, from a background thread.  This is for jobs
+//                      that follow a capture for days at a time.
+//
+// Metrics come from collectors: functions the exporter's thread calls once
+// per interval, each of which adds the current value of some metrics to a
+// CMetricsWriter.  A collector should only look at things that are safe to
+// read while the pipeline runs, such as the stats() snapshots of readers
+// and memory budgets, which are made of relaxed atomic loads.  Nothing on 
+// the hot path ever waits for the exporter.
+//
+//     CMetricsExporter exporter;
+//     exporter.add_collector([&](CMetricsWriter& writer)
+//     {
+//         add_metrics(writer, set_reader);
+//         writer.gauge("pcapreader_queue_depth", "Packets waiting to be analyzed", 
+//                      queue.depth(), metric_label("queue", "analyzer"));
+//     });
+//     exporter.start("unix:/run/myjob/metrics.sock", 10000);
+//
+// The destination is either:
+//
+//   "<path>"       - A file, replaced atomically on each update.  This suits
+//                    node_exporter's textfile collector.
+//
+//   "unix:<path>"  - A Unix domain socket.  Each connection is sent the 
+//                    latest snapshot, and then closed.
+//
+// For every counter, the exporter also publishes its rate over the last 
+// interval, as a gauge with "_total" replaced by "_per_second".
+//
+// A collector that throws doesn't stop the exporter: whatever the other
+// collectors added is still published, and the failure is counted in
+// pcapreader_exporter_collector_errors_total.
+//=============================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include "pcap_reader.h"
+#include "memory_budget.h"
+
+class CPcapSetReader;
+class CUdpSource;
+
+
+//=============================================================================
+// Builds a snapshot of metrics in the Prometheus text format
+//=============================================================================
+class CMetricsWriter
+{
+public:
+
+    // Adds a sample of a counter or a gauge.  "labels" is empty, or is one
+    // or more labels built by metric_label(), separated by commas.  Samples
+    // of the same metric can be added by several collectors, and are 
+    // grouped together in the output.
+    void    counter(const std::string& name, const std::string& help, double value, const std::string& labels = "");
+    void    gauge  (const std::string& name, const std::string& help, double value, const std::string& labels = "");
+
+    // Renders the snapshot
+    std::string text() const;
+
+    // Throws away every sample
+    void    clear() {families_.clear();}
+
+protected:
+
+    friend class CMetricsExporter;
+
+    // All of the samples of one metric
+    struct family_t
+    {
+        std::string name, help, type;
+        std::vector<std::pair<std::string, double>> samples;
+    };
+
+    // Adds a sample to a family, creating the family if need be
+    void    add(const std::string& name, const std::string& help, const char* type, 
+                double value, const std::string& labels);
+
+    // The families, in the order they were first added
+    std::vector<family_t> families_;
+};
+//=============================================================================
+
+
+//=============================================================================
+// metric_label() - Returns a label in Prometheus form, e.g. file="cap0",
+//                  with the value escaped as need be
+//=============================================================================
+std::string metric_label(const std::string& name, const std::string& value);
+//=============================================================================
+
+
+//=============================================================================
+// add_metrics() - These add the standard metrics of the library's classes
+//=============================================================================
+void add_metrics(CMetricsWriter& writer, const pcap_reader_stats_t& stats, const std::string& labels = "");
+void add_metrics(CMetricsWriter& writer, const memory_budget_stats_t& stats, const std::string& labels = "");
+void add_metrics(CMetricsWriter& writer, const CPcapReader& reader, const std::string& labels = "");
+void add_metrics(CMetricsWriter& writer, CPcapSetReader& reader, const std::string& labels = "");
+void add_metrics(CMetricsWriter& writer, const CUdpSource& source, const std::string& labels = "");
+//=============================================================================
+
+
+class CMetricsExporter
+{
+public:
+
+    using collector_t = std::function<void(CMetricsWriter&)>;
+
+    CMetricsExporter();
+    ~CMetricsExporter() {stop();}
+
+    // Adds a collector.  Call this before start().
+    void    add_collector(collector_t collector) {collectors_.push_back(collector);}
+
+    // Starts publishing a snapshot every "interval_ms" milliseconds.
+    // Will throw std::runtime_error if the destination can't be set up.
+    void    start(std::string destination, int interval_ms = 10000);
+
+    // Stops the background thread, and removes the socket if there is one
+    void    stop();
+
+    // Runs the collectors and returns the snapshot they produce
+    std::string snapshot();
+
+protected:
+
+    // The background thread
+    void    run();
+
+    // Writes a snapshot to the destination file
+    void    write_file(const std::string& text);
+
+    // Sends the latest snapshot to anyone who has connected to the socket
+    void    serve_clients(const std::string& text);
+
+    std::vector<collector_t> collectors_;
+
+    // Where the snapshots go: a file name, or the path of a listening socket
+    std::string path_;
+    int     listen_fd_;
+
+    int     interval_ms_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+
+    // The value of every counter at the previous snapshot, and when that
+    // was, for working out rates.  The mutex serializes snapshot().
+    std::mutex snapshot_mutex_;
+    std::map<std::string, double> previous_;
+    std::chrono::steady_clock::time_point previous_time_;
+
+    // The number of times a collector has thrown
+    uint64_t collector_errors_;
+};
+//=============================================================================
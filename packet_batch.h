@@ -0,0 +1,75 @@
+//=============================================================================
+// packet_batch.h - Packet views, batches of them, and the interface that
+//                  every source of packets (files, live sockets) provides.
+//
+// An analyzer written against CPacketSource doesn't know or care whether
+// its packets are coming from a PCAP file or from the network.
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+//=============================================================================
+// A lightweight view of a packet.  It doesn't own the packet data, which
+// lives in a buffer that belongs to whatever produced the view.
+//=============================================================================
+struct packet_view_t
+{
+    uint32_t        ts_seconds;
+    uint32_t        ts_nanoseconds;
+    uint32_t        length;
+    const uint8_t*  data;
+};
+//=============================================================================
+
+
+//=============================================================================
+// A batch of packet views, filled in by a CPacketSource
+//=============================================================================
+class CPacketBatch
+{
+public:
+
+    // The capacity is the maximum number of packets a batch can hold
+    explicit CPacketBatch(size_t capacity = 1024) : views_(capacity) {count_ = 0;}
+
+    // The number of packets in the batch, and the most it can hold
+    size_t  size()     const {return count_;}
+    size_t  capacity() const {return views_.size();}
+    bool    empty()    const {return count_ == 0;}
+
+    // Access to the packets in the batch
+    const packet_view_t& operator[](size_t i) const {return views_[i];}
+    const packet_view_t* begin() const {return views_.data();}
+    const packet_view_t* end()   const {return views_.data() + count_;}
+
+    // These are used by packet sources to fill in the batch
+    packet_view_t*  views() {return views_.data();}
+    void    set_size(size_t count) {count_ = count;}
+    void    clear() {count_ = 0;}
+
+protected:
+
+    std::vector<packet_view_t> views_;
+    size_t  count_;
+};
+//=============================================================================
+
+
+//=============================================================================
+// This is the interface to anything that produces batches of packets
+//=============================================================================
+class CPacketSource
+{
+public:
+
+    virtual ~CPacketSource() {}
+
+    // Fills "batch" with as many packets as are readily available.  Returns
+    // false when there are no more packets to be had.  The packet data that
+    // the views point to remains valid until the next call.
+    virtual bool get_next_batch(CPacketBatch& batch) = 0;
+};
+//=============================================================================
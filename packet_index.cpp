@@ -0,0 +1,526 @@
+//=============================================================================
+// packet_index.cpp - A compressed index of the packets in a PCAP file
+//=============================================================================
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "pcap_reader.h"
+#include "packet_index.h"
+
+using namespace std;
+
+// Every HINT_INTERVAL'th packet has the position of its high bits recorded
+static const uint64_t HINT_INTERVAL = 256;
+
+// Timestamps are compressed in blocks of this many packets
+static const uint64_t TS_BLOCK = 128;
+
+
+//=============================================================================
+// The header at the start of an index file.  The sections follow it in the
+// order below, each a whole number of 64-bit words.
+//=============================================================================
+struct index_header_t
+{
+    char        magic[8];           // "PCAPIDX1"
+    uint64_t    capture_size;       // The size of the capture when indexed
+    uint64_t    packets;
+    uint32_t    low_bits;           // Low bits per offset, stored as-is
+    uint32_t    ts_block;           // Packets per timestamp block
+    uint64_t    upper_words;        // Offsets: high bits, in unary
+    uint64_t    lower_words;        // Offsets: low bits
+    uint64_t    hint_count;         // Where every HINT_INTERVAL'th high bit is
+    uint64_t    block_count;        // Timestamps: one ts_block_t per block
+    uint64_t    ts_words;           // Timestamps: the packed residuals
+};
+
+static const char INDEX_MAGIC[8] = {'P', 'C', 'A', 'P', 'I', 'D', 'X', '1'};
+//=============================================================================
+
+
+//=============================================================================
+// A block of timestamps.  Packet "j" of the block has the timestamp
+// base + j * step + (its "width"-bit residual, at bit_offset + j * width)
+//=============================================================================
+struct ts_block_t
+{
+    uint64_t    base;
+    int64_t     step;
+    uint64_t    bit_offset;
+    uint64_t    width;
+};
+//=============================================================================
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// read_bits() - Fetches the "width"-bit value at bit "pos" of "words"
+//=============================================================================
+static inline uint64_t read_bits(const uint64_t* words, uint64_t pos, uint32_t width)
+{
+    if (width == 0) return 0;
+
+    uint64_t index = pos / 64, shift = pos % 64;
+    uint64_t value = words[index] >> shift;
+    if (shift + width > 64) value |= words[index + 1] << (64 - shift);
+
+    return (width == 64) ? value : value & ((1ULL << width) - 1);
+}
+//=============================================================================
+
+
+//=============================================================================
+// CBitWriter - Writes a stream of bits, packed into 64-bit words, to a
+//              temporary file.  Each section of the index is written to one
+//              of these while the capture is read, so the memory we need
+//              doesn't grow with the capture.
+//=============================================================================
+class CBitWriter
+{
+public:
+
+    CBitWriter()
+    {
+        fp_ = tmpfile();
+        if (fp_ == nullptr) throwRuntime("Can't create a temporary file: %s", strerror(errno));
+        buffer_.reserve(BUFFER_WORDS);
+    }
+
+    ~CBitWriter() {fclose(fp_);}
+
+    // Appends the low "width" bits of "value"
+    void    write(uint64_t value, uint32_t width)
+    {
+        if (width == 0) return;
+        if (width < 64) value &= (1ULL << width) - 1;
+
+        word_ |= value << fill_;
+        if (fill_ + width >= 64)
+        {
+            put(word_);
+            word_ = (fill_ == 0) ? 0 : value >> (64 - fill_);
+            fill_ = fill_ + width - 64;
+        }
+        else fill_ += width;
+
+        bits_ += width;
+    }
+
+    // Appends "count" zero bits
+    void    zeros(uint64_t count)
+    {
+        for (; count >= 64; count -= 64) write(0, 64);
+        write(0, count);
+    }
+
+    // The number of bits written so far
+    uint64_t bits() const {return bits_;}
+
+    // Writes out the last partial word, plus (if "pad" is true) a word of
+    // padding so that readers can always look one word ahead.  Returns the
+    // number of words.
+    uint64_t finish(bool pad)
+    {
+        if (fill_) put(word_);
+        if (pad) put(0);
+        flush();
+        return words_;
+    }
+
+    // Calls "fn" with each word we wrote, in order.  Call finish() first.
+    template <class F>
+    void    for_each_word(F fn)
+    {
+        vector<uint64_t> chunk(BUFFER_WORDS);
+        rewind(fp_);
+        size_t got;
+        while ((got = fread(chunk.data(), sizeof(uint64_t), chunk.size(), fp_)) > 0)
+        {
+            for (size_t i=0; i<got; ++i) fn(chunk[i]);
+        }
+    }
+
+    // Appends everything we wrote to "out"
+    void    copy_to(FILE* out)
+    {
+        vector<uint64_t> chunk(BUFFER_WORDS);
+        rewind(fp_);
+        size_t got;
+        while ((got = fread(chunk.data(), sizeof(uint64_t), chunk.size(), fp_)) > 0)
+        {
+            if (fwrite(chunk.data(), sizeof(uint64_t), got, out) != got) throwRuntime("Error writing index");
+        }
+    }
+
+protected:
+
+    static const size_t BUFFER_WORDS = 65536;
+
+    void    put(uint64_t word)
+    {
+        buffer_.push_back(word);
+        ++words_;
+        if (buffer_.size() == BUFFER_WORDS) flush();
+    }
+
+    void    flush()
+    {
+        if (fwrite(buffer_.data(), sizeof(uint64_t), buffer_.size(), fp_) != buffer_.size())
+            throwRuntime("Error writing temporary file: %s", strerror(errno));
+        buffer_.clear();
+    }
+
+    FILE*       fp_;
+    vector<uint64_t> buffer_;
+    uint64_t    word_  = 0;
+    uint32_t    fill_  = 0;
+    uint64_t    bits_  = 0;
+    uint64_t    words_ = 0;
+};
+//=============================================================================
+
+
+//=============================================================================
+// CIndexBuilder - Compresses offsets and timestamps as they arrive
+//=============================================================================
+class CIndexBuilder
+{
+public:
+
+    // Adds the next packet
+    void    add(uint64_t offset, uint64_t timestamp)
+    {
+        // The number of low bits depends on every offset, so they're set
+        // aside until we've seen them all
+        offsets_.write(offset, 64);
+        last_offset_ = offset;
+        ++packets_;
+
+        block_.push_back(timestamp);
+        if (block_.size() == TS_BLOCK) add_block();
+    }
+
+    // Finishes off the index and writes it to "out"
+    void    write(FILE* out, uint64_t capture_size)
+    {
+        encode_offsets();
+        if (!block_.empty()) add_block();
+
+        index_header_t header = {};
+        memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+        header.capture_size = capture_size;
+        header.packets      = packets_;
+        header.low_bits     = low_bits_;
+        header.ts_block     = TS_BLOCK;
+        header.upper_words  = upper_.finish(true);
+        header.lower_words  = lower_.finish(true);
+        header.hint_count   = hints_.finish(false);
+        header.block_count  = blocks_.finish(false) / 4;
+        header.ts_words     = ts_bits_.finish(true);
+
+        if (fwrite(&header, sizeof(header), 1, out) != 1) throwRuntime("Error writing index");
+        upper_.copy_to(out);
+        lower_.copy_to(out);
+        hints_.copy_to(out);
+        blocks_.copy_to(out);
+        ts_bits_.copy_to(out);
+    }
+
+    uint64_t packets() const {return packets_;}
+
+protected:
+
+    // The best number of low bits is log2 of the average distance between
+    // offsets, taken over the whole capture.  With that chosen, the offsets
+    // we set aside are compressed.
+    void    encode_offsets()
+    {
+        uint64_t average = packets_ ? last_offset_ / packets_ : 0;
+        low_bits_ = (average < 2) ? 0 : 63 - __builtin_clzll(average);
+
+        uint64_t i = 0;
+        offsets_.finish(false);
+        offsets_.for_each_word([&](uint64_t offset) {add_offset(i++, offset);});
+    }
+
+    // The high bits of packet i's offset are stored as a 1 at position
+    // high + i of the upper bit vector
+    void    add_offset(uint64_t i, uint64_t offset)
+    {
+        uint64_t position = (offset >> low_bits_) + i;
+        upper_.zeros(position - upper_.bits());
+        if (i % HINT_INTERVAL == 0) hints_.write(position, 64);
+        upper_.write(1, 1);
+        lower_.write(offset, low_bits_);
+    }
+
+    // Fits a line through the block's timestamps, and stores how far each
+    // lies from it, in as few bits as the block needs
+    void    add_block()
+    {
+        size_t  count = block_.size();
+        uint64_t first = block_[0];
+        int64_t step  = (count > 1) ? (int64_t)(block_[count - 1] - first) / (int64_t)(count - 1) : 0;
+
+        int64_t lowest = INT64_MAX, highest = INT64_MIN;
+        for (size_t j=0; j<count; ++j)
+        {
+            int64_t residual = (int64_t)(block_[j] - first - j * step);
+            lowest  = min(lowest,  residual);
+            highest = max(highest, residual);
+        }
+
+        uint64_t range = (uint64_t)highest - (uint64_t)lowest;
+        uint32_t width = (range == 0) ? 0 : 64 - __builtin_clzll(range);
+
+        blocks_.write(first + lowest,    64);
+        blocks_.write(step,              64);
+        blocks_.write(ts_bits_.bits(),   64);
+        blocks_.write(width,             64);
+
+        for (size_t j=0; j<count; ++j)
+        {
+            int64_t residual = (int64_t)(block_[j] - first - j * step);
+            ts_bits_.write((uint64_t)residual - (uint64_t)lowest, width);
+        }
+
+        block_.clear();
+    }
+
+    uint64_t    packets_ = 0;
+    uint64_t    last_offset_ = 0;
+    uint32_t    low_bits_ = 0;
+    vector<uint64_t> block_;
+
+    CBitWriter  offsets_, upper_, lower_, hints_, blocks_, ts_bits_;
+};
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CPacketIndex::CPacketIndex()
+{
+    map_      = nullptr;
+    map_size_ = 0;
+    packets_  = 0;
+    low_bits_ = 0;
+    upper_    = lower_ = hints_ = ts_bits_ = nullptr;
+    blocks_   = nullptr;
+}
+//=============================================================================
+
+
+//=============================================================================
+// build() - Reads the capture, and writes its index.  The index is written
+//           under a temporary name and renamed into place, so that nobody
+//           ever maps a half-written index.
+//=============================================================================
+uint64_t CPacketIndex::build(const string& capture, string index_file)
+{
+    if (index_file.empty()) index_file = capture + ".idx";
+
+    struct stat sb;
+    if (stat(capture.c_str(), &sb) != 0) throwRuntime("Can't find %s", capture.c_str());
+
+    CPcapReader reader;
+    reader.open(capture);
+    uint32_t fraction_scale = reader.is_nanosecond() ? 1 : 1000;
+
+    CIndexBuilder builder;
+    packet_view_t packet;
+
+    while (true)
+    {
+        uint64_t offset = reader.tell();
+        pcap_status_t status = reader.try_get_next_view(&packet);
+        if (status == pcap_status_t::bad_length && reader.skip_bad_record() == pcap_status_t::ok) continue;
+        if (status != pcap_status_t::ok) break;
+
+        builder.add(offset, packet.ts_seconds * 1000000000ULL + (uint64_t)packet.ts_nanoseconds * fraction_scale);
+    }
+
+    string temp_file = index_file + ".tmp";
+    FILE* out = fopen(temp_file.c_str(), "w");
+    if (out == nullptr) throwRuntime("Can't create %s", temp_file.c_str());
+
+    try
+    {
+        builder.write(out, sb.st_size);
+    }
+    catch(...)
+    {
+        fclose(out);
+        remove(temp_file.c_str());
+        throw;
+    }
+
+    if (fclose(out) != 0 || rename(temp_file.c_str(), index_file.c_str()) != 0)
+    {
+        remove(temp_file.c_str());
+        throwRuntime("Can't write %s", index_file.c_str());
+    }
+
+    return builder.packets();
+}
+//=============================================================================
+
+
+//=============================================================================
+// open() - Maps the index of a capture into memory
+//=============================================================================
+void CPacketIndex::open(const string& capture, string index_file)
+{
+    close();
+    if (index_file.empty()) index_file = capture + ".idx";
+
+    struct stat capture_sb, index_sb;
+    if (stat(capture.c_str(), &capture_sb) != 0) throwRuntime("Can't find %s", capture.c_str());
+
+    // Map the whole index file
+    int fd = ::open(index_file.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open %s", index_file.c_str());
+    if (fstat(fd, &index_sb) != 0 || (size_t)index_sb.st_size < sizeof(index_header_t))
+    {
+        ::close(fd);
+        throwRuntime("%s is not a packet index", index_file.c_str());
+    }
+
+    void* map = mmap(nullptr, index_sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) throwRuntime("Can't map %s: %s", index_file.c_str(), strerror(errno));
+    map_      = (const uint8_t*)map;
+    map_size_ = index_sb.st_size;
+
+    // Check that it's an index, that it's whole, and that it's up to date
+    const index_header_t& header = *(const index_header_t*)map_;
+    uint64_t words = header.upper_words + header.lower_words + header.hint_count
+                   + header.block_count * 4 + header.ts_words;
+
+    if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 || header.ts_block != TS_BLOCK
+    ||  sizeof(header) + words * sizeof(uint64_t) != map_size_)
+    {
+        close();
+        throwRuntime("%s is not a packet index", index_file.c_str());
+    }
+
+    if (header.capture_size != (uint64_t)capture_sb.st_size)
+    {
+        close();
+        throwRuntime("%s is out of date: %s has changed size since it was indexed",
+            index_file.c_str(), capture.c_str());
+    }
+
+    // Find the sections
+    packets_  = header.packets;
+    low_bits_ = header.low_bits;
+    upper_    = (const uint64_t*)(map_ + sizeof(header));
+    lower_    = upper_ + header.upper_words;
+    hints_    = lower_ + header.lower_words;
+    blocks_   = (const ts_block_t*)(hints_ + header.hint_count);
+    ts_bits_  = (const uint64_t*)(blocks_ + header.block_count);
+
+    // We'll look things up all over the index
+    madvise(map, map_size_, MADV_RANDOM);
+}
+//=============================================================================
+
+
+//=============================================================================
+// close() - Unmaps the index
+//=============================================================================
+void CPacketIndex::close()
+{
+    if (map_) munmap((void*)map_, map_size_);
+    map_      = nullptr;
+    map_size_ = 0;
+    packets_  = 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// offset() - Returns the offset of packet "i" in the capture.
+//
+// Its high bits are given by where the i'th 1 is in the upper bit vector.
+// The hint takes us to within HINT_INTERVAL 1s of it, and we count the rest
+// a word at a time.
+//=============================================================================
+uint64_t CPacketIndex::offset(uint64_t i) const
+{
+    if (i >= packets_) throwRuntime("Packet %lu is past the end of the index (%lu packets)", i, packets_);
+
+    uint64_t position  = hints_[i / HINT_INTERVAL];
+    uint64_t remaining = i % HINT_INTERVAL;
+
+    // Count whole words of 1s until we reach the word that holds ours
+    uint64_t index = position / 64;
+    uint64_t word  = upper_[index] & (~0ULL << (position % 64));
+    uint64_t ones;
+    while (remaining >= (ones = __builtin_popcountll(word)))
+    {
+        remaining -= ones;
+        word = upper_[++index];
+    }
+
+    // Then find ours within the word
+    for (; remaining; --remaining) word &= word - 1;
+    uint64_t high = index * 64 + __builtin_ctzll(word) - i;
+
+    return (high << low_bits_) | read_bits(lower_, i * low_bits_, low_bits_);
+}
+//=============================================================================
+
+
+//=============================================================================
+// timestamp_ns() - Returns the timestamp of packet "i"
+//=============================================================================
+uint64_t CPacketIndex::timestamp_ns(uint64_t i) const
+{
+    if (i >= packets_) throwRuntime("Packet %lu is past the end of the index (%lu packets)", i, packets_);
+
+    const ts_block_t& block = blocks_[i / TS_BLOCK];
+    uint64_t j = i % TS_BLOCK;
+    return block.base + j * block.step + read_bits(ts_bits_, block.bit_offset + j * block.width, block.width);
+}
+//=============================================================================
+
+
+//=============================================================================
+// find_time() - Binary searches for the first packet at or after "ns"
+//=============================================================================
+uint64_t CPacketIndex::find_time(uint64_t ns) const
+{
+    uint64_t low = 0, high = packets_;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (timestamp_ns(middle) < ns) low = middle + 1; else high = middle;
+    }
+    return low;
+}
+//=============================================================================
@@ -0,0 +1,107 @@
+//=============================================================================
+// packet_index.h - A compressed index of the packets in a PCAP file, kept
+//                  in a sidecar file alongside it.
+//
+// For each packet, the index holds the offset of its record in the file and
+// its timestamp.  With tens of billions of packets, a plain array of 8-byte
+// offsets would be a large file in its own right, so both are compressed:
+//
+//   Offsets     Elias-Fano coded.  The offsets only ever increase, so each
+//               is split into low bits, stored as they are, and high bits,
+//               stored in unary as gaps in a bit vector.  That comes to
+//               about 2 + log2(average record size) bits per packet.  A
+//               sampled table of where every 256th packet's high bits
+//               are makes fetching any offset O(1).
+//
+//   Timestamps  Frame-of-reference coded in blocks of 128 packets.  Each
+//               block stores a straight line through its timestamps, and
+//               each packet stores its distance from that line in as few
+//               bits as the block needs.  Regularly spaced packets cost
+//               only a few bits each.  Fetching any timestamp is O(1), and
+//               finding a time is O(log n).
+//
+// The sidecar is mapped into memory rather than read, so opening even a
+// huge index is instant, and only the pages that are used get read.
+//
+// Building the index is a single pass over the capture, with memory use
+// that doesn't depend on the size of the capture.  The offsets are set 
+// aside in a temporary file until the pass is done, since how many low bits
+// to keep depends on all of them:
+//
+//   CPacketIndex::build("cap.pcap");          // writes cap.pcap.idx
+//
+//   CPacketIndex index;
+//   index.open("cap.pcap");                   // maps cap.pcap.idx
+//   reader.seek(index.offset(1000000000));    // go to packet 10^9
+//=============================================================================
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// A block of compressed timestamps, as stored in the index file
+struct ts_block_t;
+
+
+class CPacketIndex
+{
+public:
+
+    // Constructor / destructor
+    CPacketIndex();
+    ~CPacketIndex() {close();}
+
+    // Indexes the capture, writing the index to "index_file" (by default,
+    // the capture's name with ".idx" added).  Corrupt records are skipped
+    // over, just as CPcapReader::skip_bad_record() does.  Returns the
+    // number of packets indexed.
+    // Will throw std::runtime_error on failure.
+    static uint64_t build(const std::string& capture, std::string index_file = "");
+
+    // Maps the index of the capture into memory.  "index_file" defaults as
+    // it does for build().
+    // Will throw std::runtime_error on failure, or if the capture has
+    // changed size since the index was built.
+    void    open(const std::string& capture, std::string index_file = "");
+
+    // Unmaps the index
+    void    close();
+
+    // The number of packets in the index
+    uint64_t size() const {return packets_;}
+
+    // The offset of packet "i"'s record in the capture file.
+    // Will throw std::runtime_error if "i" isn't below size().
+    uint64_t offset(uint64_t i) const;
+
+    // The timestamp of packet "i", in nanoseconds since the epoch.
+    // Will throw std::runtime_error if "i" isn't below size().
+    uint64_t timestamp_ns(uint64_t i) const;
+
+    // Returns the first packet whose timestamp is at or after "ns", or
+    // size() if there isn't one.  This assumes that the capture is in time
+    // order.
+    uint64_t find_time(uint64_t ns) const;
+
+    // The size of the index file, in bytes
+    size_t  file_size() const {return map_size_;}
+
+protected:
+
+    // The mapped index file
+    const uint8_t*  map_;
+    size_t          map_size_;
+
+    // The number of packets, and the number of low bits of each offset
+    // that are stored as they are
+    uint64_t        packets_;
+    uint32_t        low_bits_;
+
+    // The sections of the index
+    const uint64_t* upper_;
+    const uint64_t* lower_;
+    const uint64_t* hints_;
+    const ts_block_t* blocks_;
+    const uint64_t* ts_bits_;
+};
+//=============================================================================
@@ -0,0 +1,203 @@
+//=============================================================================
+// packet_parse.h - Inline parsing of Ethernet/IPv4/UDP/RDMX headers, with
+//                  the depth of the parse chosen at compile time.
+//
+// CPcapReader::parse_packet_headers() always parses every layer.  When an
+// analyzer only cares about (say) the Ethernet type, parse_headers<> lets 
+// it skip the work for the layers it doesn't look at.
+//
+// parse_compact<> and decode_headers<> produce eth_header_compact_t, which
+// is the form to use when the decoded headers of many packets are kept.
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "pcap_reader.h"
+
+
+//=============================================================================
+// How far into a packet's headers to parse
+//=============================================================================
+enum class parse_depth_t
+{
+    none,
+    ethernet,
+    ipv4,
+    udp,
+    rdmx
+};
+//=============================================================================
+
+
+//=============================================================================
+// Fields broken out from an Ethernet/IPv4/UDP/RDMX packet
+//=============================================================================
+#pragma pack(push, 1)
+struct network_order_header_t
+{
+    uint8_t     eth_dst_mac[6];
+    uint8_t     eth_src_mac[6];
+    uint16_t    eth_type;
+    
+    uint8_t     ip4_version;
+    uint8_t     ip4_dsf;
+    uint16_t    ip4_length;
+    uint16_t    ip4_id;
+    uint16_t    ip4_flags;
+    uint8_t     ip4_ttl;
+    uint8_t     ip4_protocol;
+    uint16_t    ip4_checksum;
+    uint32_t    ip4_src_ip;
+    uint32_t    ip4_dst_ip;
+
+    uint16_t    udp_src_port;
+    uint16_t    udp_dst_port;
+    uint16_t    udp_length;
+    uint16_t    udp_checksum;
+
+    uint16_t    rdmx_magic;
+    uint64_t    rdmx_target;
+};
+#pragma pack(pop)
+//=============================================================================
+
+
+//=============================================================================
+// These fetch big-endian fields from a packet
+//=============================================================================
+inline uint16_t fetch_be16(uint16_t field) {return __builtin_bswap16(field);}
+inline uint32_t fetch_be32(uint32_t field) {return __builtin_bswap32(field);}
+inline uint64_t fetch_be64(uint64_t field) {return __builtin_bswap64(field);}
+//=============================================================================
+
+
+//=============================================================================
+// parse_headers() - Parses the headers of a raw packet down to the layer 
+//                   given by "Depth".  The fields of deeper layers are left 
+//                   untouched, and their "is_xxx" flags are false.
+//
+// With Depth = parse_depth_t::rdmx, the result is the same as that of 
+// CPcapReader::parse_packet_headers()
+//=============================================================================
+template <parse_depth_t Depth>
+inline void parse_headers(const uint8_t* data, eth_header_t* header)
+{
+    const network_order_header_t& no_packet = *(const network_order_header_t*)data;
+    eth_header_t& result = *header;
+
+    result.is_ethernet = false;
+    result.is_ipv4     = false;
+    result.is_udp      = false;
+    result.is_rdmx     = false;
+
+    if constexpr (Depth >= parse_depth_t::ethernet)
+    {
+        memcpy(result.eth_dst_mac, no_packet.eth_dst_mac, 6);
+        memcpy(result.eth_src_mac, no_packet.eth_src_mac, 6);
+        result.eth_type    = fetch_be16(no_packet.eth_type);
+        result.is_ethernet = (result.eth_type == 0x800);
+    }
+
+    if constexpr (Depth >= parse_depth_t::ipv4)
+    {
+        result.ip4_version  = no_packet.ip4_version;
+        result.ip4_dsf      = no_packet.ip4_dsf;
+        result.ip4_length   = fetch_be16(no_packet.ip4_length);
+        result.ip4_id       = fetch_be16(no_packet.ip4_id);
+        result.ip4_flags    = fetch_be16(no_packet.ip4_flags);
+        result.ip4_ttl      = no_packet.ip4_ttl;
+        result.ip4_protocol = no_packet.ip4_protocol;
+        result.ip4_checksum = fetch_be16(no_packet.ip4_checksum);
+        result.ip4_src_ip   = fetch_be32(no_packet.ip4_src_ip);
+        result.ip4_dst_ip   = fetch_be32(no_packet.ip4_dst_ip);
+        result.is_ipv4      = result.is_ethernet && (result.ip4_version == 0x45);
+    }
+
+    if constexpr (Depth >= parse_depth_t::udp)
+    {
+        result.udp_src_port = fetch_be16(no_packet.udp_src_port);
+        result.udp_dst_port = fetch_be16(no_packet.udp_dst_port);
+        result.udp_length   = fetch_be16(no_packet.udp_length);
+        result.udp_checksum = fetch_be16(no_packet.udp_checksum);
+        result.is_udp       = result.is_ipv4 && (result.ip4_protocol == 0x11);
+    }
+
+    if constexpr (Depth >= parse_depth_t::rdmx)
+    {
+        result.rdmx_magic   = fetch_be16(no_packet.rdmx_magic);
+        result.rdmx_target  = fetch_be64(no_packet.rdmx_target);
+        result.is_rdmx      = result.is_udp && (result.rdmx_magic == 0x0122);
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// parse_compact() - Parses the headers of a raw packet into the compact 
+//                   layout, down to the layer given by "Depth".  The fields
+//                   of deeper layers are left untouched.
+//=============================================================================
+template <parse_depth_t Depth>
+inline void parse_compact(const uint8_t* data, eth_header_compact_t* header)
+{
+    const network_order_header_t& no_packet = *(const network_order_header_t*)data;
+    eth_header_compact_t& result = *header;
+
+    uint8_t layers = 0;
+
+    if constexpr (Depth >= parse_depth_t::ethernet)
+    {
+        memcpy(result.eth_dst_mac, no_packet.eth_dst_mac, 6);
+        memcpy(result.eth_src_mac, no_packet.eth_src_mac, 6);
+        result.eth_type = fetch_be16(no_packet.eth_type);
+        layers = (result.eth_type == 0x800);
+    }
+
+    if constexpr (Depth >= parse_depth_t::ipv4)
+    {
+        result.ip4_version  = no_packet.ip4_version;
+        result.ip4_dsf      = no_packet.ip4_dsf;
+        result.ip4_length   = fetch_be16(no_packet.ip4_length);
+        result.ip4_id       = fetch_be16(no_packet.ip4_id);
+        result.ip4_flags    = fetch_be16(no_packet.ip4_flags);
+        result.ip4_ttl      = no_packet.ip4_ttl;
+        result.ip4_protocol = no_packet.ip4_protocol;
+        result.ip4_checksum = fetch_be16(no_packet.ip4_checksum);
+        result.ip4_src_ip   = fetch_be32(no_packet.ip4_src_ip);
+        result.ip4_dst_ip   = fetch_be32(no_packet.ip4_dst_ip);
+        layers += (layers == 1 && result.ip4_version == 0x45);
+    }
+
+    if constexpr (Depth >= parse_depth_t::udp)
+    {
+        result.udp_src_port = fetch_be16(no_packet.udp_src_port);
+        result.udp_dst_port = fetch_be16(no_packet.udp_dst_port);
+        result.udp_length   = fetch_be16(no_packet.udp_length);
+        result.udp_checksum = fetch_be16(no_packet.udp_checksum);
+        layers += (layers == 2 && result.ip4_protocol == 0x11);
+    }
+
+    if constexpr (Depth >= parse_depth_t::rdmx)
+    {
+        result.rdmx_magic   = fetch_be16(no_packet.rdmx_magic);
+        result.rdmx_target  = fetch_be64(no_packet.rdmx_target);
+        layers += (layers == 3 && result.rdmx_magic == 0x0122);
+    }
+
+    result.layers = layers;
+}
+//=============================================================================
+
+
+//=============================================================================
+// decode_headers() - Parses the headers of every packet in a batch into an 
+//                    array of compact headers, which must have room for 
+//                    batch.size() entries
+//=============================================================================
+template <parse_depth_t Depth = parse_depth_t::rdmx>
+inline void decode_headers(const CPacketBatch& batch, eth_header_compact_t* headers)
+{
+    size_t count = batch.size();
+    for (size_t i=0; i<count; ++i) parse_compact<Depth>(batch[i].data, &headers[i]);
+}
+//=============================================================================
@@ -0,0 +1,386 @@
+//=============================================================================
+// pcap_generator.cpp - Writes synthetic PCAP files of any size
+//=============================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <stdexcept>
+#include "pcap_generator.h"
+#include "pcap_reader.h"
+
+using namespace std;
+
+// The output is flushed to disk whenever this much of it has been built
+static const size_t FLUSH_SIZE = 4 * 1024 * 1024;
+
+// The biggest frame we'll generate.  CPcapReader reports anything bigger
+// as bad_length.
+static const uint32_t MAX_FRAME = sizeof(pcap_packet_t::data);
+
+// The snapshot length written to the file header
+static const uint32_t SNAPLEN = 65535;
+
+// The timestamp of the first packet
+static const uint64_t START_TIME = 1600000000ull * 1000000000;
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// These store big-endian fields into a frame
+//=============================================================================
+static inline void put16(uint8_t* p, uint16_t v) {v = __builtin_bswap16(v); memcpy(p, &v, 2);}
+static inline void put32(uint8_t* p, uint32_t v) {v = __builtin_bswap32(v); memcpy(p, &v, 4);}
+static inline void put64(uint8_t* p, uint64_t v) {v = __builtin_bswap64(v); memcpy(p, &v, 8);}
+//=============================================================================
+
+
+//=============================================================================
+// ip4_checksum() - Computes the checksum of a 20-byte IPv4 header
+//=============================================================================
+static uint16_t ip4_checksum(const uint8_t* header)
+{
+    uint32_t sum = 0;
+    for (int i=0; i<20; i += 2) sum += (header[i] << 8) | header[i+1];
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CPcapGenerator::CPcapGenerator(const pcap_generator_config_t& config)
+{
+    config_ = config;
+    if (config_.flows == 0) config_.flows = 1;
+
+    parse_size_mix(config_.size_mix);
+    parse_timestamps(config_.timestamps);
+
+    // The payload filler is a recognizable, repeating byte pattern
+    payload_.resize(MAX_FRAME);
+    for (size_t i=0; i<payload_.size(); ++i) payload_[i] = (uint8_t)i;
+
+    packets_ = bytes_ = corrupted_ = 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// parse_size_mix() - Parses the packet size specification
+//=============================================================================
+void CPcapGenerator::parse_size_mix(const string& spec)
+{
+    sizes_.clear();
+    weights_.clear();
+    uniform_min_ = 64;
+    uniform_max_ = 1500;
+
+    if (spec == "imix")
+    {
+        sizes_   = {64, 576, 1500};
+        weights_ = {7, 11, 12};
+        return;
+    }
+
+    if (spec == "uniform") return;
+
+    if (spec.compare(0, 8, "uniform:") == 0)
+    {
+        if (sscanf(spec.c_str() + 8, "%u-%u", &uniform_min_, &uniform_max_) != 2
+        ||  uniform_min_ > uniform_max_)
+            throwRuntime("Bad size mix '%s'", spec.c_str());
+        if (uniform_max_ > MAX_FRAME)
+            throwRuntime("Bad size mix '%s': packets can be at most %u bytes", spec.c_str(), MAX_FRAME);
+        return;
+    }
+
+    // Otherwise it's a size, or a list of sizes and weights
+    uint64_t total = 0;
+    const char* p = spec.c_str();
+    while (*p)
+    {
+        char* end;
+        unsigned long size = strtoul(p, &end, 10), weight = 1;
+        if (end == p) throwRuntime("Bad size mix '%s'", spec.c_str());
+        if (*end == ':') weight = strtoul(p = end + 1, &end, 10);
+        if (size == 0 || weight == 0) throwRuntime("Bad size mix '%s'", spec.c_str());
+        if (size > MAX_FRAME) throwRuntime("Bad size mix '%s': packets can be at most %u bytes", spec.c_str(), MAX_FRAME);
+
+        total += weight;
+        sizes_.push_back(size);
+        weights_.push_back(total);
+
+        if (*end == ',') ++end;
+        else if (*end) throwRuntime("Bad size mix '%s'", spec.c_str());
+        p = end;
+    }
+
+    if (sizes_.empty()) throwRuntime("Bad size mix '%s'", spec.c_str());
+}
+//=============================================================================
+
+
+//=============================================================================
+// parse_timestamps() - Parses the timestamp pattern specification
+//=============================================================================
+void CPcapGenerator::parse_timestamps(const string& spec)
+{
+    unsigned long long a, b, c;
+    gap_ns_ = burst_count_ = idle_ns_ = 0;
+
+    if (sscanf(spec.c_str(), "constant:%llu", &a) == 1)
+    {
+        ts_mode_ = CONSTANT;
+        gap_ns_  = a;
+    }
+    else if (sscanf(spec.c_str(), "jitter:%llu", &a) == 1)
+    {
+        ts_mode_ = JITTER;
+        gap_ns_  = a;
+    }
+    else if (sscanf(spec.c_str(), "burst:%llu:%llu:%llu", &a, &b, &c) == 3 && a > 0)
+    {
+        ts_mode_     = BURST;
+        burst_count_ = a;
+        gap_ns_      = b;
+        idle_ns_     = c;
+    }
+    else throwRuntime("Bad timestamp pattern '%s'", spec.c_str());
+}
+//=============================================================================
+
+
+//=============================================================================
+// next_size() - Returns the size of the next packet
+//=============================================================================
+uint32_t CPcapGenerator::next_size()
+{
+    if (sizes_.empty()) return uniform_min_ + random() % (uniform_max_ - uniform_min_ + 1);
+
+    uint64_t r = random() % weights_.back();
+    size_t i = 0;
+    while (weights_[i] <= r) ++i;
+    return sizes_[i];
+}
+//=============================================================================
+
+
+//=============================================================================
+// next_gap() - Returns the time between the previous packet and the next
+//=============================================================================
+uint64_t CPcapGenerator::next_gap()
+{
+    switch (ts_mode_)
+    {
+        case CONSTANT:  return gap_ns_;
+        case JITTER:    return random() % (2 * gap_ns_ + 1);
+        case BURST:     return (packets_ % burst_count_) ? gap_ns_ : idle_ns_;
+    }
+    return 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// build_frame() - Builds the next frame
+//=============================================================================
+uint32_t CPcapGenerator::build_frame(uint8_t* frame, uint32_t length)
+{
+    uint32_t flow = random() % config_.flows;
+    bool vlan = chance(config_.vlan_fraction);
+    bool ipv6 = chance(config_.ipv6_fraction);
+    bool tcp  = chance(config_.tcp_fraction);
+    bool rdmx = !tcp && chance(config_.rdmx_fraction);
+
+    // Work out where each header goes, and make sure they fit
+    uint32_t l3     = vlan ? 18 : 14;
+    uint32_t l4     = l3 + (ipv6 ? 40 : 20);
+    uint32_t data   = l4 + (tcp ? 20 : 8);
+    uint32_t needed = data + (rdmx ? 10 : 0);
+    if (length < needed) length = needed;
+
+    // The Ethernet header, with the VLAN tag if there is one
+    static const uint8_t macs[12] = {2,0,0,0,0,1, 2,0,0,0,0,2};
+    memcpy(frame, macs, sizeof(macs));
+    uint16_t eth_type = ipv6 ? 0x86DD : 0x0800;
+    if (vlan)
+    {
+        put16(frame + 12, 0x8100);
+        put16(frame + 14, 1 + flow % 4094);
+        put16(frame + 16, eth_type);
+    }
+    else put16(frame + 12, eth_type);
+
+    // The IP header
+    uint8_t* ip = frame + l3;
+    uint8_t protocol = tcp ? 6 : 17;
+    if (ipv6)
+    {
+        put32(ip, 0x60000000);
+        put16(ip + 4, length - l4);
+        ip[6] = protocol;
+        ip[7] = 64;
+        memset(ip + 8, 0, 32);
+        put16(ip +  8, 0xFD00);
+        put32(ip + 20, flow);
+        put16(ip + 24, 0xFD01);
+        put32(ip + 36, flow);
+    }
+    else
+    {
+        ip[0] = 0x45;
+        ip[1] = 0;
+        put16(ip +  2, length - l3);
+        put16(ip +  4, (uint16_t)packets_);
+        put16(ip +  6, 0x4000);
+        ip[8] = 64;
+        ip[9] = protocol;
+        put16(ip + 10, 0);
+        put32(ip + 12, 0x0A000000 | (flow & 0xFFFFFF));
+        put32(ip + 16, 0x0A800000 | (flow & 0xFFFFFF));
+        put16(ip + 10, ip4_checksum(ip));
+    }
+
+    // The UDP or TCP header
+    uint8_t* l4_header = frame + l4;
+    put16(l4_header + 0, 1024 + flow % 64000);
+    put16(l4_header + 2, 5000 + flow / 64000);
+    if (tcp)
+    {
+        put32(l4_header +  4, (uint32_t)packets_);
+        put32(l4_header +  8, 0);
+        put16(l4_header + 12, 0x5018);
+        put16(l4_header + 14, 0xFFFF);
+        put32(l4_header + 16, 0);
+    }
+    else
+    {
+        put16(l4_header + 4, length - l4);
+        put16(l4_header + 6, 0);
+    }
+
+    // The RDMX header.  Each flow writes to successive addresses.
+    if (rdmx)
+    {
+        put16(frame + data, 0x0122);
+        put64(frame + data + 2, flow_target_[flow]);
+        flow_target_[flow] += length - needed;
+    }
+
+    // And the payload
+    memcpy(frame + needed, payload_.data(), length - needed);
+    return length;
+}
+//=============================================================================
+
+
+//=============================================================================
+// write() - Writes a capture file
+//=============================================================================
+void CPcapGenerator::write(string filename)
+{
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throwRuntime("Can't create %s: %s", filename.c_str(), strerror(errno));
+
+    // Start from the same place every time, so a configuration always 
+    // produces the same file
+    rng_ = config_.seed * 0x9E3779B97F4A7C15ull | 1;
+    flow_target_.assign(config_.flows, 0);
+    packets_ = bytes_ = corrupted_ = 0;
+
+    vector<uint8_t> buffer(FLUSH_SIZE + 16 + MAX_FRAME);
+    size_t used = 0;
+
+    // Writes out whatever is in the buffer
+    auto flush = [&]()
+    {
+        for (size_t done = 0; done < used; )
+        {
+            ssize_t n = ::write(fd, buffer.data() + done, used - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0)
+            {
+                ::close(fd);
+                throwRuntime("Can't write %s: %s", filename.c_str(), strerror(errno));
+            }
+            done += n;
+        }
+        used = 0;
+    };
+
+    // The file header
+    pcap_header_t header = {config_.microseconds ? 0xA1B2C3D4 : 0xA1B23C4D, 2, 4, 0, 0, SNAPLEN, 1};
+    memcpy(buffer.data(), &header, sizeof(header));
+    used = bytes_ = sizeof(header);
+
+    uint64_t timestamp  = START_TIME;
+    uint32_t last_length = 0;
+    while (config_.packet_count ? packets_ < config_.packet_count : bytes_ < config_.total_bytes)
+    {
+        timestamp += next_gap();
+
+        uint8_t* record = buffer.data() + used;
+        uint32_t length = build_frame(record + 16, next_size());
+
+        // The packet header
+        uint32_t field[4];
+        field[0] = timestamp / 1000000000;
+        field[1] = timestamp % 1000000000;
+        field[2] = length;
+        field[3] = length;
+        if (config_.microseconds) field[1] /= 1000;
+
+        // Corrupt the length field of some packets with something that's
+        // obviously too big
+        if (chance(config_.corrupt_fraction))
+        {
+            field[2] = 0x80000000 | (uint32_t)random();
+            ++corrupted_;
+        }
+
+        memcpy(record, field, sizeof(field));
+        used   += 16 + length;
+        bytes_ += 16 + length;
+        last_length = length;
+        ++packets_;
+
+        if (used >= FLUSH_SIZE) flush();
+    }
+
+    flush();
+
+    // If we've been asked to, cut the last packet short
+    if (config_.truncate_last && packets_)
+    {
+        bytes_ -= (16 + last_length) / 2;
+        if (ftruncate(fd, bytes_) != 0)
+        {
+            ::close(fd);
+            throwRuntime("Can't truncate %s: %s", filename.c_str(), strerror(errno));
+        }
+    }
+
+    ::close(fd);
+}
+//=============================================================================
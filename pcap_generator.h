@@ -0,0 +1,134 @@
+//=============================================================================
+// pcap_generator.h - Writes synthetic PCAP files of any size, for 
+//                    benchmarks and scale tests.
+//
+// The packets are Ethernet frames carrying IPv4 or IPv6, optionally VLAN
+// tagged, carrying UDP (with or without an RDMX header) or TCP.  The mix of
+// each, the packet sizes, the number of flows and the spacing of the 
+// timestamps are all configurable, and a fraction of the packets can be 
+// deliberately corrupted.  The output is built in large buffers and 
+// written with one system call per buffer, so generation runs at about 
+// the speed of the disk.
+//=============================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+//=============================================================================
+// What to generate
+//=============================================================================
+struct pcap_generator_config_t
+{
+    // Stop once the file is this big...
+    uint64_t    total_bytes = 64ull << 20;
+
+    // ...or, if this isn't zero, after writing this many packets
+    uint64_t    packet_count = 0;
+
+    // Packet sizes (the whole frame, excluding the PCAP packet header):
+    //   "<n>"                  - every packet is n bytes
+    //   "imix"                 - 64, 576 and 1500 bytes in the ratio 7:4:1
+    //   "uniform"              - uniformly distributed from 64 to 1500
+    //   "uniform:<min>-<max>"  - uniformly distributed from min to max
+    //   "<n>:<weight>,..."     - a weighted mix of sizes
+    // No size may be more than CPcapReader accepts (10000 bytes).
+    std::string size_mix = "imix";
+
+    // The number of distinct flows (address/port combinations)
+    uint32_t    flows = 16;
+
+    // The fractions of packets that are VLAN tagged, are IPv6 rather than
+    // IPv4, are TCP rather than UDP, and (of the UDP ones) carry RDMX
+    double      vlan_fraction    = 0.0;
+    double      ipv6_fraction    = 0.0;
+    double      tcp_fraction     = 0.0;
+    double      rdmx_fraction    = 1.0;
+
+    // Packet spacing:
+    //   "constant:<ns>"                 - a fixed gap between packets
+    //   "jitter:<ns>"                   - a random gap averaging ns
+    //   "burst:<count>:<gap>:<idle>"    - bursts of "count" packets "gap" 
+    //                                     ns apart, separated by "idle" ns
+    std::string timestamps = "jitter:1000";
+
+    // Write microsecond timestamps rather than nanosecond ones
+    bool        microseconds = false;
+
+    // The fraction of packets whose length field is corrupted, and whether
+    // to cut the last packet short
+    double      corrupt_fraction = 0.0;
+    bool        truncate_last    = false;
+
+    // The seed for the random number generator
+    uint64_t    seed = 1;
+};
+//=============================================================================
+
+
+class CPcapGenerator
+{
+public:
+
+    // Will throw std::runtime_error if the configuration is malformed
+    explicit CPcapGenerator(const pcap_generator_config_t& config);
+
+    // Writes a capture file.
+    // Will throw std::runtime_error on failure.
+    void    write(std::string filename);
+
+    // What the last write() produced
+    uint64_t packets_written()   const {return packets_;}
+    uint64_t bytes_written()     const {return bytes_;}
+    uint64_t packets_corrupted() const {return corrupted_;}
+
+protected:
+
+    // Returns a random number
+    uint64_t random()
+    {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 7;
+        rng_ ^= rng_ << 17;
+        return rng_;
+    }
+
+    // Returns true with probability "fraction"
+    bool    chance(double fraction) {return fraction > 0 && (random() >> 11) * 0x1.0p-53 < fraction;}
+
+    // Parses the size mix and timestamp specifications
+    void    parse_size_mix(const std::string& spec);
+    void    parse_timestamps(const std::string& spec);
+
+    // Returns the size of the next packet, and the gap before it
+    uint32_t next_size();
+    uint64_t next_gap();
+
+    // Builds the next frame at "frame", with room for "length" bytes.  
+    // Returns the length actually used, which can be larger if the headers
+    // don't fit in "length".
+    uint32_t build_frame(uint8_t* frame, uint32_t length);
+
+    pcap_generator_config_t config_;
+    uint64_t rng_;
+
+    // The size mix, as a table of sizes and cumulative weights, or a range
+    std::vector<uint32_t> sizes_;
+    std::vector<uint64_t> weights_;
+    uint32_t uniform_min_, uniform_max_;
+
+    // The timestamp pattern
+    enum {CONSTANT, JITTER, BURST} ts_mode_;
+    uint64_t gap_ns_, burst_count_, idle_ns_;
+
+    // Filler for the packet payloads
+    std::vector<uint8_t> payload_;
+
+    // The next RDMX target address of each flow
+    std::vector<uint64_t> flow_target_;
+
+    // Results of the last write()
+    uint64_t packets_, bytes_, corrupted_;
+};
+//=============================================================================
@@ -4,65 +4,73 @@
 //                   fields to be little-endian.
 //=============================================================================
 
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <cstdio>
 #include <cstdint>
 #include <cstring>
 #include <cstdarg>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include "pcap_reader.h"
+#include "packet_parse.h"
+#include "cpu_dispatch.h"
 
 using namespace std;
 
 //=============================================================================
-// Fields broken out from an Ethernet/IPv4/UDP/RDMX packet
+// throwRuntime() - Throws a runtime exception
 //=============================================================================
-#pragma pack(push, 1)
-struct network_order_header_t
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
 {
-    uint8_t     eth_dst_mac[6];
-    uint8_t     eth_src_mac[6];
-    uint16_t    eth_type;
-    
-    uint8_t     ip4_version;
-    uint8_t     ip4_dsf;
-    uint16_t    ip4_length;
-    uint16_t    ip4_id;
-    uint16_t    ip4_flags;
-    uint8_t     ip4_ttl;
-    uint8_t     ip4_protocol;
-    uint16_t    ip4_checksum;
-    uint32_t    ip4_src_ip;
-    uint32_t    ip4_dst_ip;
-
-    uint16_t    udp_src_port;
-    uint16_t    udp_dst_port;
-    uint16_t    udp_length;
-    uint16_t    udp_checksum;
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
 
-    uint16_t    rdmx_magic;
-    uint64_t    rdmx_target;
-};
-#pragma pack(pop)
+    throw runtime_error(buffer);
+}
 //=============================================================================
 
 
 
 //=============================================================================
-// throwRuntime() - Throws a runtime exception
+// Constructor
 //=============================================================================
-static void throwRuntime(const char* fmt, ...)
+CPcapReader::CPcapReader()
 {
-    char buffer[1024];
-    va_list ap;
-    va_start(ap, fmt);
-    vsprintf(buffer, fmt, ap);
-    va_end(ap);
-
-    throw runtime_error(buffer);
+    fp_             = nullptr;
+    block_          = nullptr;
+    block_capacity_ = 0;
+    block_pos_      = 0;
+    block_end_      = 0;
+    block_mode_     = false;
+    bad_length_     = 0;
+    corrupt_offset_ = UINT64_MAX;
+    stride_         = 0;
+    pool_           = nullptr;
+    budget_         = nullptr;
 }
 //=============================================================================
 
 
+//=============================================================================
+// Destructor
+//=============================================================================
+CPcapReader::~CPcapReader()
+{
+    close();
+
+    // Give back the memory our private buffers were charged against
+    if (budget_ && !block_storage_.empty()) budget_->release(block_storage_.size());
+    if (budget_ && !stream_buffer_.empty()) budget_->release(stream_buffer_.size());
+}
+//=============================================================================
+
 
 //=============================================================================
 // open() - Opens a PCAP file.   
@@ -76,6 +84,17 @@ void CPcapReader::open(string filename)
     // Complain if we can't open the input file
     if (fp_ == nullptr) throwRuntime("Can't open %s", filename.c_str());
 
+    // If we have a memory budget, read through a buffer it's paying for
+    if (budget_)
+    {
+        if (stream_buffer_.empty())
+        {
+            budget_->reserve(STREAM_BUFFER_SIZE);
+            stream_buffer_.resize(STREAM_BUFFER_SIZE);
+        }
+        setvbuf(fp_, stream_buffer_.data(), _IOFBF, stream_buffer_.size());
+    }
+
     // Read in the PCAP header
     if (fread(&header_, 1, sizeof(header_), fp_) != sizeof(header_))
         throwRuntime("File is not a nanosecond/little-endian PCAP file");
@@ -85,6 +104,16 @@ void CPcapReader::open(string filename)
     // as though they were nanosecond timestamps
     if (header_.magic_number != 0xA1B23C4D && header_.magic_number != 0xA1B2C3D4)
         throwRuntime("File is not a nanosecond/little-endian PCAP file");
+
+    // The block buffer is empty
+    block_pos_ = block_end_ = 0;
+    block_mode_ = false;
+
+    fd_ = fileno(fp_);
+    read_offset_ = sizeof(header_);
+    corrupt_offset_ = UINT64_MAX;
+
+    detect_stride();
 }
 //=============================================================================
 
@@ -96,9 +125,16 @@ void CPcapReader::close()
 {
     if (fp_)
     {
+        fd_ = -1;
         fclose(fp_);
         fp_ = nullptr;
     }
+
+    stride_ = 0;
+
+    // Throw away whatever was left in the block buffer
+    block_pos_ = block_end_ = 0;
+    block_mode_ = false;
 }
 //=============================================================================
 
@@ -110,24 +146,744 @@ void CPcapReader::close()
 //=============================================================================
 bool CPcapReader::get_next_packet(pcap_packet_t* packet)
 {
-    // If there is no file open, treat it as an EOF
-    if (fp_ == nullptr)
-        throwRuntime("File not open");
+    pcap_status_t status = try_get_next_packet(packet);
+    if (status == pcap_status_t::ok) return true;
+    if (status == pcap_status_t::eof || status == pcap_status_t::truncated) return false;
+    throw_status(status);
+}
+//=============================================================================
+
+
+//=============================================================================
+// try_get_next_packet() - Fetches the next packet from the file without
+//                         throwing.
+//
+// Returns pcap_status_t::ok on success
+//=============================================================================
+pcap_status_t CPcapReader::try_get_next_packet(pcap_packet_t* packet) noexcept
+{
+    // If there is no file open, tell the caller
+    if (fp_ == nullptr) return pcap_status_t::not_open;
 
     // If we don't have a full packet header available, we're at EOF
-    if (fread(packet, 1, 16, fp_) != 16)
-        return false;
+    size_t got = fread(packet, 1, 16, fp_);
+    bump(counters_.read_calls, 1);
+    bump(counters_.bytes_read, got);
+    if (got != 16) return rewind_partial(got);
 
     // If the packet data won't fit into the data field, something is awry.
+    // Back up to the start of the packet so that skip_bad_record() can 
+    // find it.
     if (packet->length > sizeof(packet->data))
-        throwRuntime("Bad packet length [%u] !\n", packet->length);
+    {
+        note_corrupt(packet->length, read_offset_.load(memory_order_relaxed));
+        fseek(fp_, -16, SEEK_CUR);
+        return pcap_status_t::bad_length;
+    }
 
     // If we can't read all of the packet data, we're at EOF
-    if (fread(packet->data, 1, packet->length, fp_) != packet->length) 
-        return false;
+    got = fread(packet->data, 1, packet->length, fp_);
+    bump(counters_.read_calls, 1);
+    bump(counters_.bytes_read, got);
+    if (got != packet->length) return rewind_partial(16 + got);
 
     // Otherwise, tell the caller they have a packet available
-    return true;        
+    PCAPREADER_PROBE3(packet_read, packet->length, packet->ts_seconds, packet->ts_nanoseconds);
+    bump(read_offset_, 16 + packet->length);
+    bump(counters_.packets, 1);
+    bump(counters_.bytes, packet->length);
+    bump(counters_.copied_bytes, packet->length);
+    return pcap_status_t::ok;
+}
+//=============================================================================
+
+
+//=============================================================================
+// get_next_batch() - Fetches a batch of packets from the file.
+//
+// Returns 'true' on success, or 'false' if no more packets are available
+//=============================================================================
+bool CPcapReader::get_next_batch(CPacketBatch& batch)
+{
+    packet_view_t* views = batch.views();
+    size_t capacity = batch.capacity();
+    batch.clear();
+
+    // Fetch the first packet, reading more of the file if need be.  This is
+    // the only place we refill, since a refill moves the data that the 
+    // views in this batch would be pointing to.
+    pcap_status_t status = try_get_next_view(&views[0]);
+    if (status == pcap_status_t::eof || status == pcap_status_t::truncated) return false;
+    if (status != pcap_status_t::ok) throw_status(status);
+
+    // Hand back as many more packets as the block has on hand.  If we run
+    // into a bad one, the next call will report it.
+    size_t count = 1;
+    while (count < capacity && take_record(&views[count]) == pcap_status_t::ok) ++count;
+
+    batch.set_size(count);
+    return true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// throw_status() - Throws the exception that describes a failed status
+//=============================================================================
+void CPcapReader::throw_status(pcap_status_t status)
+{
+    if (status == pcap_status_t::bad_length)
+        throwRuntime("Bad packet length [%u] !\n", bad_length_);
+
+    throwRuntime("%s", pcap_status_string(status));
+}
+//=============================================================================
+
+
+//=============================================================================
+// try_refill() - Moves any partial packet at the end of the block to the 
+//                front, then fills the rest of the block from the file.
+//
+// Returns pcap_status_t::ok if more data was read
+//=============================================================================
+pcap_status_t CPcapReader::try_refill() noexcept
+{
+    // If there is no file open, tell the caller
+    if (fp_ == nullptr) return pcap_status_t::not_open;
+
+    block_mode_ = true;
+    size_t leftover = block_end_ - block_pos_;
+
+    // When reading from a pool, packets handed out of the current block may
+    // still be in use.  If so, we move on to a fresh block and leave the 
+    // current one to be released by whoever is holding those packets.
+    if (pool_)
+    {
+        if (!pool_block_.unique())
+        {
+            CBlockRef fresh;
+            try
+            {
+                fresh = pool_->acquire();
+            }
+            catch(const exception&)
+            {
+                return pcap_status_t::out_of_memory;
+            }
+            move_leftover(fresh.data());
+            pool_block_ = move(fresh);
+            block_capacity_ = pool_->block_size() - BLOCK_SLACK;
+        }
+    }
+
+    // Otherwise we use our private block, allocating it the first time
+    else if (block_ == nullptr || block_ != block_storage_.data())
+    {
+        if (block_storage_.empty())
+        {
+            // We mustn't throw, and shouldn't stall for ever, so the wait
+            // for the budget is bounded
+            bool reserved = false;
+            try
+            {
+                if (budget_)
+                {
+                    reserved = budget_->reserve_for(BLOCK_SIZE + BLOCK_SLACK, BUDGET_TIMEOUT);
+                    if (!reserved) return pcap_status_t::out_of_memory;
+                }
+                block_storage_.resize(BLOCK_SIZE + BLOCK_SLACK);
+            }
+            catch(const exception&)
+            {
+                if (reserved) budget_->release(BLOCK_SIZE + BLOCK_SLACK);
+                return pcap_status_t::out_of_memory;
+            }
+        }
+        move_leftover(block_storage_.data());
+        pool_block_.reset();
+        block_capacity_ = BLOCK_SIZE;
+    }
+
+    // Slide the partial packet (if any) to the front of the block
+    move_leftover(block_);
+
+    // Read as much as will fit, keeping track of how long we wait for it
+    auto start = chrono::steady_clock::now();
+    size_t got = fread(block_ + block_end_, 1, block_capacity_ - block_end_, fp_);
+    auto elapsed = chrono::steady_clock::now() - start;
+    block_end_ += got;
+
+    bump(read_offset_, got);
+    bump(counters_.refills, 1);
+    bump(counters_.read_calls, 1);
+    bump(counters_.bytes_read, got);
+    uint64_t blocked_ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+    bump(counters_.io_blocked_ns, blocked_ns);
+    PCAPREADER_PROBE2(block_refill, got, blocked_ns);
+    if (got) return pcap_status_t::ok;
+
+    // We hit the end of the file.  Clear the EOF indicator so that we can
+    // try again later if the file is still being written.
+    bool failed = ferror(fp_);
+    clearerr(fp_);
+    if (failed) return pcap_status_t::io_error;
+    return leftover ? pcap_status_t::truncated : pcap_status_t::eof;
+}
+//=============================================================================
+
+
+//=============================================================================
+// move_leftover() - Moves the partial packet (if any) at the end of the 
+//                   block to "destination", and makes that the block
+//=============================================================================
+void CPcapReader::move_leftover(uint8_t* destination) noexcept
+{
+    size_t leftover = block_end_ - block_pos_;
+    if (leftover && destination != block_ + block_pos_)
+        memmove(destination, block_ + block_pos_, leftover);
+
+    block_     = destination;
+    block_pos_ = 0;
+    block_end_ = leftover;
+}
+//=============================================================================
+
+
+//=============================================================================
+// set_block_pool() - Tells the reader to read into blocks from a pool
+//=============================================================================
+void CPcapReader::set_block_pool(CBlockPool* pool)
+{
+    // Every block has to be able to hold the biggest packet we accept
+    if (pool && pool->block_size() < 16 + sizeof(pcap_packet_t::data) + BLOCK_SLACK)
+        throwRuntime("Block pool blocks of %zu bytes are too small", pool->block_size());
+
+    pool_ = pool;
+}
+//=============================================================================
+
+
+//=============================================================================
+// set_memory_budget() - Tells the reader to charge its private block buffer
+//                       against a memory budget
+//=============================================================================
+void CPcapReader::set_memory_budget(CMemoryBudget* budget)
+{
+    if (!block_storage_.empty() || !stream_buffer_.empty())
+        throwRuntime("set_memory_budget() must be called before reading");
+
+    // Both buffers are charged to the budget, and neither is given back
+    // while we read, so the budget must hold them both at once
+    if (budget && budget->stats().limit < BLOCK_SIZE + BLOCK_SLACK + STREAM_BUFFER_SIZE)
+        throwRuntime("The reader's buffers won't fit in the memory budget");
+
+    budget_ = budget;
+}
+//=============================================================================
+
+
+//=============================================================================
+// use_own_pool() - Creates a block pool for get_next_shared() to use when
+//                  it hasn't been given one
+//=============================================================================
+bool CPcapReader::use_own_pool() noexcept
+{
+    try
+    {
+        own_pool_.reset(new CBlockPool(BLOCK_SIZE + BLOCK_SLACK));
+    }
+    catch(const exception&)
+    {
+        return false;
+    }
+
+    pool_ = own_pool_.get();
+    return true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// rewind_partial() - Called when we hit EOF part way through a packet.  If
+//                    we consumed any bytes of it, back up to the start of 
+//                    the packet so the next read can try again.  This is 
+//                    what allows a file that is still being written to be 
+//                    followed.
+//
+// Returns the status that describes where we stopped
+//=============================================================================
+pcap_status_t CPcapReader::rewind_partial(size_t consumed) noexcept
+{
+    // Clear the error and EOF indicators so that subsequent reads will 
+    // try again
+    bool failed = ferror(fp_);
+    clearerr(fp_);
+    if (failed) return pcap_status_t::io_error;
+
+    // If we read part of a packet, back up to the start of it
+    if (consumed == 0) return pcap_status_t::eof;
+    fseek(fp_, -(long)consumed, SEEK_CUR);
+    return pcap_status_t::truncated;
+}
+//=============================================================================
+
+
+//=============================================================================
+// is_plausible() - Returns true if a packet header looks like it could be
+//                  genuine.  This is how we find our footing again after a
+//                  corrupt packet.
+//=============================================================================
+static bool is_plausible(const uint8_t* record)
+{
+    uint32_t field[4];
+    memcpy(field, record, sizeof(field));
+
+    return field[1] < 1000000000
+        && field[2] <= sizeof(pcap_packet_t::data)
+        && field[2] <= field[3];
+}
+//=============================================================================
+
+
+//=============================================================================
+// find_plausible() - Searches "size" bytes for the first plausible packet
+//                    header.
+//
+// Returns the offset of the header if one was found.  Otherwise, returns the
+// offset of the first byte that couldn't be checked because the header 
+// starting there would run past the end.  Either way, a header was found if
+// the return value + 16 <= size.
+//
+// A plausible length is below 65536, so the top two bytes of its length 
+// field are zero.  Positions are screened for that 32 at a time, a byte per
+// position, which the compiler vectorizes; only the 32 positions that hold
+// a candidate get the full test.  Unaligned 32-bit loads at every byte 
+// offset don't vectorize, so testing every field of every position was no
+// faster than doing it one position at a time.
+//=============================================================================
+PCAPREADER_CPU_CLONES
+static size_t find_plausible(const uint8_t* data, size_t size)
+{
+    static_assert(sizeof(pcap_packet_t::data) < 65536, "the screen assumes 16-bit lengths");
+
+    if (size < 16) return 0;
+    size_t end = size - 15, pos = 0;
+
+    for (; pos + 32 <= end; pos += 32)
+    {
+        const uint8_t* chunk = data + pos;
+        unsigned candidates = 0;
+        for (int i=0; i<32; ++i) candidates |= (chunk[i + 10] | chunk[i + 11]) == 0;
+        if (candidates == 0) continue;
+
+        for (int i=0; i<32; ++i)
+        {
+            if (is_plausible(chunk + i)) return pos + i;
+        }
+    }
+
+    for (; pos < end; ++pos)
+    {
+        if (is_plausible(data + pos)) return pos;
+    }
+
+    return end;
+}
+//=============================================================================
+
+
+//=============================================================================
+// skip_bad_record() - Moves past a packet that was reported as bad_length.
+//
+// If the packet's length is no bigger than the file's snaplen, we believe
+// it and step over the packet.  Otherwise we search forward, one byte at a
+// time, for the next packet header that looks plausible.
+//
+// Returns pcap_status_t::ok if we found our footing
+//=============================================================================
+pcap_status_t CPcapReader::skip_bad_record() noexcept
+{
+    // If there is no file open, tell the caller
+    if (fp_ == nullptr) return pcap_status_t::not_open;
+
+    bump(counters_.records_skipped, 1);
+
+    // If the length looks genuine, just step over the packet
+    if (bad_length_ <= header_.snaplen)
+    {
+        size_t skip = 16 + (size_t)bad_length_;
+        bump(counters_.bytes_skipped, skip);
+
+        // In block mode, use up what's in the block before seeking the file
+        if (block_mode_)
+        {
+            size_t available = block_end_ - block_pos_;
+            size_t consumed  = (skip < available) ? skip : available;
+            block_pos_ += consumed;
+            skip       -= consumed;
+            if (skip == 0) return pcap_status_t::ok;
+            block_pos_ = block_end_ = 0;
+        }
+
+        if (fseek(fp_, skip, SEEK_CUR) != 0) return pcap_status_t::io_error;
+        bump(read_offset_, skip);
+        return pcap_status_t::ok;
+    }
+
+    // Otherwise search for the next plausible packet header
+    return block_mode_ ? scan_block() : scan_stream();
+}
+//=============================================================================
+
+
+//=============================================================================
+// scan_block() - Searches the block for the next plausible packet header,
+//                starting just past the bad one.
+//=============================================================================
+pcap_status_t CPcapReader::scan_block() noexcept
+{
+    size_t pos = block_pos_ + 1;
+    uint64_t skipped = 0;
+
+    while (true)
+    {
+        // Look through what's in the block
+        if (pos < block_end_) pos += find_plausible(block_ + pos, block_end_ - pos);
+        if (pos + 16 <= block_end_)
+        {
+            bump(counters_.bytes_skipped, skipped + pos - block_pos_);
+            block_pos_ = pos;
+            return pcap_status_t::ok;
+        }
+
+        // We didn't find one.  Keep the bytes that might be the start of a 
+        // header, and read more of the file.
+        size_t keep = (pos < block_end_) ? pos : block_end_;
+        skipped += keep - block_pos_;
+        block_pos_ = keep;
+        pcap_status_t status = try_refill();
+        if (status != pcap_status_t::ok)
+        {
+            bump(counters_.bytes_skipped, skipped);
+            return status;
+        }
+        pos = 0;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// scan_stream() - Searches the file for the next plausible packet header,
+//                 starting just past the bad one.
+//=============================================================================
+pcap_status_t CPcapReader::scan_stream() noexcept
+{
+    uint8_t chunk[64 * 1024];
+
+    // Start looking one byte past the start of the bad packet
+    long start = ftell(fp_), base = start + 1;
+
+    while (fseek(fp_, base, SEEK_SET) == 0)
+    {
+        size_t got = fread(chunk, 1, sizeof(chunk), fp_);
+        bump(counters_.read_calls, 1);
+        bump(counters_.bytes_read, got);
+
+        size_t pos = find_plausible(chunk, got);
+        if (pos + 16 <= got)
+        {
+            fseek(fp_, base + pos, SEEK_SET);
+            read_offset_.store(base + pos, memory_order_relaxed);
+            bump(counters_.bytes_skipped, base + pos - start);
+            return pcap_status_t::ok;
+        }
+
+        // If that was the end of the file, we didn't find one.  Leave the
+        // file positioned at the last few bytes, which can't be a packet.
+        if (got < sizeof(chunk))
+        {
+            long stop = base + (got < 16 ? 0 : got - 15);
+            clearerr(fp_);
+            fseek(fp_, stop, SEEK_SET);
+            read_offset_.store(stop, memory_order_relaxed);
+            bump(counters_.bytes_skipped, stop - start);
+            return pcap_status_t::eof;
+        }
+
+        // Otherwise, keep the bytes that might be the start of a header
+        base += got - 15;
+    }
+
+    return pcap_status_t::io_error;
+}
+//=============================================================================
+
+
+//=============================================================================
+// stats() - Takes a snapshot of the reader's counters
+//=============================================================================
+pcap_reader_stats_t CPcapReader::stats() const
+{
+    auto get = [](const atomic<uint64_t>& counter) {return counter.load(memory_order_relaxed);};
+
+    // Packets that were copied are counted in "bytes" too, so fetch this 
+    // first to make sure it can't come out ahead
+    uint64_t copied = get(counters_.copied_bytes);
+
+    pcap_reader_stats_t stats;
+    stats.packets              = get(counters_.packets);
+    stats.bytes                = get(counters_.bytes);
+    stats.records_corrupt      = get(counters_.records_corrupt);
+    stats.records_skipped      = get(counters_.records_skipped);
+    stats.bytes_skipped        = get(counters_.bytes_skipped);
+    stats.read_calls           = get(counters_.read_calls);
+    stats.bytes_read           = get(counters_.bytes_read);
+    stats.refills              = get(counters_.refills);
+    stats.io_blocked_ns        = get(counters_.io_blocked_ns);
+    stats.memcpy_bytes_avoided = (stats.bytes > copied) ? stats.bytes - copied : 0;
+    return stats;
+}
+//=============================================================================
+
+
+//=============================================================================
+// bytes_behind() - Returns how much of the file we haven't read yet
+//=============================================================================
+uint64_t CPcapReader::bytes_behind() const
+{
+    struct stat sb;
+    int fd = fd_.load(memory_order_relaxed);
+    if (fd < 0 || fstat(fd, &sb) != 0) return 0;
+
+    uint64_t offset = read_offset_.load(memory_order_relaxed);
+    return ((uint64_t)sb.st_size > offset) ? sb.st_size - offset : 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// detect_stride() - Checks whether every record in the file is the same 
+//                   size.
+//
+// The first record says what the stride would have to be.  Rather than 
+// read the whole file, we check a sample of records spread evenly across 
+// it, including the last.  Anything that reads at a calculated position
+// checks the length of the records it finds there too.
+//=============================================================================
+void CPcapReader::detect_stride()
+{
+    const uint64_t SAMPLES = 64;
+
+    stride_ = 0;
+    int fd = fd_.load(memory_order_relaxed);
+
+    // Find the length of the first record
+    uint32_t field[4];
+    if (pread(fd, field, sizeof(field), sizeof(header_)) != sizeof(field)) return;
+    if (field[2] == 0 || field[2] > sizeof(pcap_packet_t::data)) return;
+    uint32_t stride = 16 + field[2];
+
+    // Find out how many records there would be
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) return;
+    uint64_t count = (sb.st_size - sizeof(header_)) / stride;
+    if (count == 0) return;
+
+    // And check that the sampled records are all the same length
+    for (uint64_t i=0; i<=SAMPLES; ++i)
+    {
+        uint64_t index = (count - 1) * i / SAMPLES;
+        uint32_t sample[4];
+        if (pread(fd, sample, sizeof(sample), sizeof(header_) + index * stride) != sizeof(sample)) return;
+        if (sample[2] != field[2] || sample[1] >= 1000000000) return;
+    }
+
+    stride_ = stride;
+}
+//=============================================================================
+
+
+//=============================================================================
+// record_count() - Returns the number of complete records in a file that 
+//                  has a constant stride
+//=============================================================================
+uint64_t CPcapReader::record_count() const
+{
+    struct stat sb;
+    int fd = fd_.load(memory_order_relaxed);
+    if (stride_ == 0 || fd < 0 || fstat(fd, &sb) != 0) return 0;
+    if ((uint64_t)sb.st_size < sizeof(header_)) return 0;
+    return (sb.st_size - sizeof(header_)) / stride_;
+}
+//=============================================================================
+
+
+//=============================================================================
+// seek() - Positions the reader at the record at "offset" in the file
+//=============================================================================
+void CPcapReader::seek(uint64_t offset)
+{
+    if (fp_ == nullptr) throw_status(pcap_status_t::not_open);
+    if (fseek(fp_, offset, SEEK_SET) != 0) throwRuntime("Can't seek to offset %lu", offset);
+
+    // Whatever is in the block came from somewhere else in the file
+    block_pos_ = block_end_ = 0;
+    read_offset_.store(offset, memory_order_relaxed);
+}
+//=============================================================================
+
+
+//=============================================================================
+// seek_packet() - Positions the reader at packet "index" of a file that has
+//                 a constant stride.
+//
+// The stride was only sampled when the file was opened, so the record at 
+// the calculated position is checked before we go there
+//=============================================================================
+void CPcapReader::seek_packet(uint64_t index)
+{
+    if (fp_ == nullptr) throw_status(pcap_status_t::not_open);
+    if (stride_ == 0) throwRuntime("File doesn't have a constant record stride");
+
+    // If there's a record header there, it has to be one of ours.  Past the
+    // last record, there's nothing to check, and reading will report eof.
+    uint64_t offset = sizeof(header_) + index * stride_;
+    uint32_t field[4];
+    ssize_t got = pread(fd_.load(memory_order_relaxed), field, sizeof(field), offset);
+    if (got < 0) throwRuntime("Error reading packet %lu: %s", index, strerror(errno));
+    bump(counters_.read_calls, 1);
+    bump(counters_.bytes_read, got);
+
+    if (got == sizeof(field) && (field[2] != stride_ - 16 || field[1] >= 1000000000))
+        throwRuntime("Packet %lu isn't %u bytes long, so the file's stride isn't constant", index, stride_ - 16);
+
+    seek(offset);
+}
+//=============================================================================
+
+
+//=============================================================================
+// read_packet_at() - Fetches packet "index" of a file that has a constant 
+//                    stride, with a single read
+//
+// Returns 'true' on success, or 'false' if the file isn't that long
+//=============================================================================
+bool CPcapReader::read_packet_at(uint64_t index, pcap_packet_t* packet)
+{
+    if (fp_ == nullptr) throw_status(pcap_status_t::not_open);
+    if (stride_ == 0) throwRuntime("File doesn't have a constant record stride");
+
+    ssize_t got = pread(fd_.load(memory_order_relaxed), packet, stride_, sizeof(header_) + index * stride_);
+    if (got < 0) throwRuntime("Error reading packet %lu: %s", index, strerror(errno));
+    bump(counters_.read_calls, 1);
+    bump(counters_.bytes_read, got);
+    if ((size_t)got < stride_) return false;
+
+    if (packet->length != stride_ - 16)
+        throwRuntime("Packet %lu isn't %u bytes long, so the file's stride isn't constant", index, stride_ - 16);
+
+    PCAPREADER_PROBE3(packet_read, packet->length, packet->ts_seconds, packet->ts_nanoseconds);
+    bump(counters_.packets, 1);
+    bump(counters_.bytes, packet->length);
+    bump(counters_.copied_bytes, packet->length);
+    return true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// extract_timestamps() - Copies the timestamps out of "count" records that 
+//                        are "stride" bytes apart.  
+//
+// Returns false if any of the records isn't the expected length.  That's
+// checked without branching so that the loop can be vectorized, and the 
+// loop is compiled for several instruction sets.  Each field is loaded on
+// its own: a vector of 12-byte structures isn't something the vectorizer 
+// can build.
+//=============================================================================
+PCAPREADER_CPU_CLONES PCAPREADER_STRIDED_VECTORIZE
+static bool extract_timestamps(const uint8_t* records, uint32_t stride, size_t count,
+                               uint32_t* seconds, uint32_t* nanoseconds)
+{
+    uint32_t expected = stride - 16, mismatch = 0;
+
+    for (size_t i=0; i<count; ++i)
+    {
+        const uint8_t* record = records + i * stride;
+        uint32_t ts_seconds, ts_nanoseconds, length;
+        memcpy(&ts_seconds,     record,     4);
+        memcpy(&ts_nanoseconds, record + 4, 4);
+        memcpy(&length,         record + 8, 4);
+        seconds[i]     = ts_seconds;
+        nanoseconds[i] = ts_nanoseconds;
+        mismatch      |= length ^ expected;
+    }
+
+    return mismatch == 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// read_timestamps() - Fetches the timestamps of "count" packets, starting 
+//                     at packet "first", of a file that has a constant 
+//                     stride.
+//
+// The records are mapped into memory rather than read, so that nothing is
+// copied and only the cache lines holding the record headers are touched.
+//
+// Returns the number of timestamps fetched
+//=============================================================================
+size_t CPcapReader::read_timestamps(uint64_t first, size_t count, uint32_t* seconds, uint32_t* nanoseconds)
+{
+    if (fp_ == nullptr) throw_status(pcap_status_t::not_open);
+    if (stride_ == 0) throwRuntime("File doesn't have a constant record stride");
+
+    // Don't go past the records the file has.  With nothing to fetch there's
+    // nothing to map, and mmap() would refuse an empty mapping anyway.
+    uint64_t available = record_count();
+    if (count == 0 || first >= available) return 0;
+    count = min<uint64_t>(count, available - first);
+
+    // Map the pages that hold those records
+    uint64_t start  = sizeof(header_) + first * stride_;
+    uint64_t base   = start & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+    size_t   length = start - base + count * stride_;
+    void* map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd_.load(memory_order_relaxed), base);
+    if (map == MAP_FAILED) throwRuntime("Can't map packets %lu to %lu: %s", first, first + count - 1, strerror(errno));
+    madvise(map, length, MADV_SEQUENTIAL);
+
+    bool ok = extract_timestamps((const uint8_t*)map + (start - base), stride_, count, seconds, nanoseconds);
+    munmap(map, length);
+
+    if (!ok)
+    {
+        throwRuntime("A packet between %lu and %lu isn't %u bytes long, so the file's stride isn't constant",
+            first, first + count - 1, stride_ - 16);
+    }
+
+    return count;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_status_string() - Returns a description of a status
+//=============================================================================
+const char* pcap_status_string(pcap_status_t status)
+{
+    switch (status)
+    {
+        case pcap_status_t::ok:            return "OK";
+        case pcap_status_t::eof:           return "End of file";
+        case pcap_status_t::truncated:     return "Truncated packet";
+        case pcap_status_t::bad_length:    return "Bad packet length";
+        case pcap_status_t::not_open:      return "File not open";
+        case pcap_status_t::io_error:      return "Error reading file";
+        case pcap_status_t::out_of_memory: return "Out of memory";
+    }
+    return "Unknown status";
 }
 //=============================================================================
 
@@ -234,11 +990,11 @@ static void print_header(eth_header_t& header)
 //                          packet into a structure with all of the fields
 //                          broken out.
 //=============================================================================
-void CPcapReader::parse_packet_headers(unsigned char* data, eth_header_t* header)
+void CPcapReader::parse_packet_headers(const unsigned char* data, eth_header_t* header)
 {
     // Get a convenient reference to the "network order"
     // Ethernet/IPv4/UDP/RDMX header
-    network_order_header_t& no_packet = *(network_order_header_t*)data;
+    const network_order_header_t& no_packet = *(const network_order_header_t*)data;
 
     // Get a convenient reference to the caller's result structure
     eth_header_t& result = *(eth_header_t*)header;
@@ -3,8 +3,19 @@
 //                 nanosecond timestamp resolution and for the header fields
 //                 to be little-endian.
 //=============================================================================
+#pragma once
 #include <string>
+#include <cstdio>
 #include <cstdint>
+#include <cstring>
+#include <vector>
+#include <iterator>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include "packet_batch.h"
+#include "block_pool.h"
+#include "usdt_probes.h"
 
 
 //=============================================================================
@@ -58,6 +69,52 @@ struct eth_header_t
 //=============================================================================
 
 
+//=============================================================================
+// The same fields as eth_header_t, in a compact layout for storing the 
+// decoded headers of many packets.  The four "is_xxx" flags are replaced by
+// a single count of the layers that were recognized, and the fields are 
+// ordered by size so there are no padding holes.  The fields most analyzers
+// filter on come first, in the first 16 bytes.
+//=============================================================================
+struct alignas(8) eth_header_compact_t
+{
+    // How many layers were recognized: 0 = none, 1 = Ethernet, 2 = IPv4,
+    // 3 = UDP, 4 = RDMX.  Like the "is_xxx" fields of eth_header_t, each 
+    // layer implies the ones beneath it.
+    uint8_t     layers;
+    uint8_t     ip4_protocol;
+    uint16_t    eth_type;
+    uint32_t    ip4_src_ip;
+    uint32_t    ip4_dst_ip;
+    uint16_t    udp_src_port;
+    uint16_t    udp_dst_port;
+
+    uint64_t    rdmx_target;
+
+    uint16_t    ip4_length;
+    uint16_t    ip4_id;
+    uint16_t    ip4_flags;
+    uint16_t    ip4_checksum;
+    uint16_t    udp_length;
+    uint16_t    udp_checksum;
+    uint16_t    rdmx_magic;
+
+    uint8_t     eth_dst_mac[6];
+    uint8_t     eth_src_mac[6];
+    uint8_t     ip4_version;
+    uint8_t     ip4_dsf;
+    uint8_t     ip4_ttl;
+    uint8_t     reserved[3];
+
+    bool is_ethernet() const {return layers >= 1;}
+    bool is_ipv4()     const {return layers >= 2;}
+    bool is_udp()      const {return layers >= 3;}
+    bool is_rdmx()     const {return layers >= 4;}
+};
+static_assert(sizeof(eth_header_compact_t) == 56, "eth_header_compact_t should be 56 bytes");
+//=============================================================================
+
+
 //=============================================================================
 // This is the header of a PCAP file
 //=============================================================================
@@ -93,41 +150,464 @@ struct pcap_packet_t
 //=============================================================================
 
 
+//=============================================================================
+// The outcome of the non-throwing read functions
+//=============================================================================
+enum class pcap_status_t : uint8_t
+{
+    ok,             // A packet was returned
+    eof,            // There are no more packets in the file
+    truncated,      // The file ends part way through a packet
+    bad_length,     // The packet is too long to be believed
+    not_open,       // No file is open
+    io_error,       // The operating system reported a read error
+    out_of_memory   // A buffer to read into couldn't be allocated, or the
+                    // memory budget had no room for it
+};
+
+// Returns a description of a status
+const char* pcap_status_string(pcap_status_t status);
+//=============================================================================
+
+
+//=============================================================================
+// A snapshot of what a reader has done since it was constructed.  Snapshots
+// from several readers can be added together.
+//=============================================================================
+struct pcap_reader_stats_t
+{
+    // Packets handed back, and the bytes of packet data in them
+    uint64_t    packets = 0;
+    uint64_t    bytes = 0;
+
+    // Records found corrupt, and the records that skip_bad_record() stepped
+    // or scanned past, along with the bytes it threw away
+    uint64_t    records_corrupt = 0;
+    uint64_t    records_skipped = 0;
+    uint64_t    bytes_skipped = 0;
+
+    // Read calls made on the file, and the bytes they returned
+    uint64_t    read_calls = 0;
+    uint64_t    bytes_read = 0;
+
+    // Block refills, and the time spent waiting for them to be read.  Only
+    // the block-based reads are timed: get_next_packet() makes two small 
+    // reads per packet, and timing those would cost more than the reads.
+    uint64_t    refills = 0;
+    uint64_t    io_blocked_ns = 0;
+
+    // Bytes of packet data handed back as views into the block, rather than 
+    // copied out as get_next_packet() does
+    uint64_t    memcpy_bytes_avoided = 0;
+
+    // Returns the average size of a read
+    double      bytes_per_read() const {return read_calls ? (double)bytes_read / read_calls : 0;}
+
+    pcap_reader_stats_t& operator+=(const pcap_reader_stats_t& rhs)
+    {
+        packets              += rhs.packets;
+        bytes                += rhs.bytes;
+        records_corrupt      += rhs.records_corrupt;
+        records_skipped      += rhs.records_skipped;
+        bytes_skipped        += rhs.bytes_skipped;
+        read_calls           += rhs.read_calls;
+        bytes_read           += rhs.bytes_read;
+        refills              += rhs.refills;
+        io_blocked_ns        += rhs.io_blocked_ns;
+        memcpy_bytes_avoided += rhs.memcpy_bytes_avoided;
+        return *this;
+    }
+};
+//=============================================================================
+
+
 //=============================================================================
 // This class is used to sequentially read a PCAP file
+//
+// Packets can be read either one at a time with get_next_packet(), which
+// copies each packet into the caller's buffer, or with get_next_view(), 
+// get_next_batch() or a range-based for loop, all of which read the file in
+// large blocks and hand back views that point directly into the block. 
+// Don't mix get_next_packet() with the others on the same open file.
+//
+//     for (auto& packet : reader) ...
+//
+// The try_xxx() functions never throw.  Instead they return a status, and
+// after a bad_length status, skip_bad_record() can be used to carry on.
 //=============================================================================
-class CPcapReader
+class CPcapReader : public CPacketSource
 {
 public:
 
+    // An input iterator over the packets in the file.  Incrementing it
+    // invalidates the view that it previously pointed to.
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = packet_view_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const packet_view_t*;
+        using reference         = const packet_view_t&;
+
+        // A default-constructed iterator is the end of the file
+        iterator() {reader_ = nullptr;}
+        explicit iterator(CPcapReader* reader) {reader_ = reader; ++(*this);}
+
+        reference operator* () const {return view_;}
+        pointer   operator->() const {return &view_;}
+
+        iterator& operator++()
+        {
+            if (!reader_->get_next_view(&view_)) reader_ = nullptr;
+            return *this;
+        }
+
+        bool operator==(const iterator& rhs) const {return reader_ == rhs.reader_;}
+        bool operator!=(const iterator& rhs) const {return reader_ != rhs.reader_;}
+
+    protected:
+        CPcapReader*    reader_;
+        packet_view_t   view_;
+    };
+
     // Constructor / destructor
-    CPcapReader() {fp_ = nullptr;}
-    ~CPcapReader() {close();}
+    CPcapReader();
+    ~CPcapReader();
 
     // Call this to open a PCAP file.
     // Will throw std::runtime_error on failure.
     void    open(std::string filename);
 
     // This fetches the next packet from an open file.  Returns false when there
-    // are no more packets available to read.  
+    // are no more packets available to read.  If only part of a packet is
+    // available, the file is left positioned at the start of that packet so
+    // that a later call can pick it up once the rest has been written.
     // Will throw std::runtime_error on failure.    
     bool    get_next_packet(pcap_packet_t*);
 
+    // The same as get_next_packet(), but never throws
+    pcap_status_t try_get_next_packet(pcap_packet_t*) noexcept;
+
+    // Fetches as many packets as will fit in the batch from the current 
+    // block, reading the next block from the file if need be.  Returns false
+    // when there are no more packets available to read.  The views remain
+    // valid until the next call.
+    // Will throw std::runtime_error on failure.
+    bool    get_next_batch(CPacketBatch& batch) override;
+
+    // Fetches a view of the next packet, reading the next block from the
+    // file if need be.  Returns false when there are no more packets 
+    // available to read.  The view remains valid until the next call.
+    // Will throw std::runtime_error on failure.
+    bool    get_next_view(packet_view_t* view)
+    {
+        pcap_status_t status = try_get_next_view(view);
+        if (status == pcap_status_t::ok) return true;
+        if (status == pcap_status_t::eof || status == pcap_status_t::truncated) return false;
+        throw_status(status);
+    }
+
+    // The same as get_next_view(), but never throws
+    pcap_status_t try_get_next_view(packet_view_t* view) noexcept
+    {
+        pcap_status_t status;
+        while ((status = take_record(view)) == pcap_status_t::truncated)
+        {
+            status = try_refill();
+            if (status != pcap_status_t::ok) return status;
+        }
+        return status;
+    }
+
+    // Fetches a view of the next packet only if it's already in the block.
+    // Since this never reads from the file, it leaves views that were 
+    // fetched earlier intact.  Returns truncated if the block doesn't hold
+    // a complete packet.
+    pcap_status_t try_get_buffered_view(packet_view_t* view) noexcept
+    {
+        return take_record(view);
+    }
+
+    // Reads the file into blocks from "pool" from the next block onward.
+    // Pass nullptr to go back to the reader's private block buffer.
+    // Will throw std::runtime_error if the pool's blocks are too small.
+    void    set_block_pool(CBlockPool* pool);
+
+    // Charges the reader's private block buffer against "budget".  Call
+    // this before reading.  Files opened after this are read through a 
+    // stdio buffer of our own, which is charged against it too.  If the
+    // budget has no room for the block, the first read waits up to
+    // BUDGET_TIMEOUT for it, then fails with pcap_status_t::out_of_memory.
+    // Will throw std::runtime_error if the block and the stdio buffer 
+    // won't both fit in the budget.
+    void    set_memory_budget(CMemoryBudget* budget);
+
+    // The same as get_next_view(), except that the packet holds a reference
+    // to the block it lives in.  It stays valid, and can be handed to other
+    // threads, for as long as it's held.  If no pool has been given to 
+    // set_block_pool(), the reader creates one of its own.  In that case,
+    // every shared packet must be dropped before the reader is destroyed.
+    // Will throw std::runtime_error on failure.
+    bool    get_next_shared(shared_packet_t* packet)
+    {
+        pcap_status_t status = try_get_next_shared(packet);
+        if (status == pcap_status_t::ok) return true;
+        if (status == pcap_status_t::eof || status == pcap_status_t::truncated) return false;
+        throw_status(status);
+    }
+
+    // The same as get_next_shared(), but never throws
+    pcap_status_t try_get_next_shared(shared_packet_t* packet) noexcept
+    {
+        if (pool_ == nullptr && !use_own_pool()) return pcap_status_t::out_of_memory;
+        pcap_status_t status = try_get_next_view(&packet->view);
+        if (status == pcap_status_t::ok) packet->block = pool_block_;
+        return status;
+    }
+
+    // After a read returns bad_length, this moves past the bad packet so 
+    // that reading can continue.  Returns pcap_status_t::ok if it found the
+    // next packet, or eof if there wasn't one.
+    pcap_status_t skip_bad_record() noexcept;
+
+    // Iteration over the packets that haven't been read yet
+    iterator begin() {return iterator(this);}
+    iterator end()   {return iterator();}
+
     // Call this to close the input file
     void    close();
 
     // This parses the headers of a raw packet into fields
-    void    parse_packet_headers(unsigned char* data, eth_header_t* header);
+    void    parse_packet_headers(const unsigned char* data, eth_header_t* header);
+
+    // Fetches the reader's counters.  They accumulate across every file the
+    // reader opens.  Safe to call from any thread, while reading is going on.
+    pcap_reader_stats_t stats() const;
+
+    // Returns how far the reader is behind the end of the file, in bytes.
+    // Data already read into the block counts as read.  This is how a job
+    // following a file that's being written can tell if it's keeping up.
+    // Safe to call from any thread.
+    uint64_t bytes_behind() const;
+
+    // The header of the open file
+    const pcap_header_t& file_header() const {return header_;}
+
+    // True if the file's timestamps are in nanoseconds rather than 
+    // microseconds.  Either way, the reader hands back the sub-second part
+    // of the timestamp as it appears in the file.
+    bool    is_nanosecond() const {return header_.magic_number == 0xA1B23C4D;}
+
+    // The offset in the file of the next record to be read
+    uint64_t tell() const 
+    {
+        return read_offset_.load(std::memory_order_relaxed) - (block_end_ - block_pos_);
+    }
+
+    // Positions the reader so that the next record read is the one at
+    // "offset" in the file, such as one found by tell() or a CPacketIndex.
+    // Will throw std::runtime_error on failure.
+    void    seek(uint64_t offset);
+
+    // Many captures (FPGA data in particular) are made entirely of records 
+    // of one size.  open() checks for this by sampling the file, and if it
+    // finds it, the position of any packet can simply be calculated.  That 
+    // allows reading packets in any order without an index, and splitting a
+    // file exactly between threads: each opens the file, calls 
+    // seek_packet() to go to the start of its share, and reads its share of
+    // record_count() packets.
+
+    // The distance from one record to the next, if every record in the file
+    // is the same size.  Otherwise, 0.
+    uint32_t record_stride() const {return stride_;}
+
+    // The number of complete records in the file right now, if it has a 
+    // constant stride.  Otherwise, 0.
+    uint64_t record_count() const;
+
+    // Positions the reader so that the next packet read is packet "index"
+    // (counting from 0).  Needs a constant stride.
+    // Will throw std::runtime_error on failure, or if the record there isn't
+    // the expected size.
+    void    seek_packet(uint64_t index);
+
+    // Fetches packet "index" without disturbing the reader's position. 
+    // Returns false if the file doesn't have that many packets.  Needs a 
+    // constant stride.  Will throw std::runtime_error on failure, or if the
+    // record isn't the expected size.
+    bool    read_packet_at(uint64_t index, pcap_packet_t* packet);
+
+    // Fetches the timestamps of "count" packets starting at packet "first",
+    // without disturbing the reader's position.  Returns how many were 
+    // fetched, which is fewer than "count" at the end of the file.  Needs a
+    // constant stride.  Will throw std::runtime_error on failure, or if any
+    // of the records isn't the expected size.
+    size_t  read_timestamps(uint64_t first, size_t count, uint32_t* seconds, uint32_t* nanoseconds);
 
 protected:
 
+    // The counters behind stats().  Only the reading thread writes them, so
+    // rather than an atomic add, each update is a relaxed load and store,
+    // which costs no more than incrementing a plain integer.
+    struct counters_t
+    {
+        std::atomic<uint64_t> packets{0}, bytes{0}, copied_bytes{0};
+        std::atomic<uint64_t> records_corrupt{0}, records_skipped{0}, bytes_skipped{0};
+        std::atomic<uint64_t> read_calls{0}, bytes_read{0}, refills{0}, io_blocked_ns{0};
+    };
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    // Counts the corrupt record at "offset", unless it was the last one
+    // counted.  A record is found corrupt again each time it's read until
+    // skip_bad_record() moves past it, and some callers peek at it first.
+    void    note_corrupt(uint32_t length, uint64_t offset) noexcept
+    {
+        bad_length_ = length;
+        if (offset == corrupt_offset_) return;
+        corrupt_offset_ = offset;
+        bump(counters_.records_corrupt, 1);
+        PCAPREADER_PROBE2(corrupt_record, length, offset);
+    }
+
+    // Backs up to the start of a partially read packet
+    pcap_status_t rewind_partial(size_t consumed) noexcept;
+
+    // If the block holds a complete packet, fills in a view of it
+    pcap_status_t take_record(packet_view_t* view) noexcept;
+
+    // Throws the exception that corresponds to a status
+    [[noreturn]] void throw_status(pcap_status_t status);
+
+    // Reads more of the file into the block
+    pcap_status_t try_refill() noexcept;
+
+    // Moves the unconsumed part of the block to "destination", which then
+    // becomes the block
+    void    move_leftover(uint8_t* destination) noexcept;
+
+    // Creates the pool that get_next_shared() uses when it isn't given one.
+    // Returns false if it can't be allocated.
+    bool    use_own_pool() noexcept;
+
+    // These search for the next plausible packet after a corrupt one
+    pcap_status_t scan_block() noexcept;
+    pcap_status_t scan_stream() noexcept;
+
+    // The size of the block that get_next_batch() reads the file into
+    static const size_t BLOCK_SIZE = 1024 * 1024;
+
+    // The size of the stdio buffer we give the file when we have a budget
+    static const size_t STREAM_BUFFER_SIZE = 64 * 1024;
+
+    // How long the first read waits for the memory budget to have room for
+    // the block before giving up with pcap_status_t::out_of_memory
+    static constexpr std::chrono::milliseconds BUDGET_TIMEOUT{1000};
+
+    // Extra bytes allocated past the end of the block, so that parsing the
+    // headers of a runt packet at the very end of the block can't run off
+    // the end of the buffer
+    static const size_t BLOCK_SLACK = 64;
+
     FILE*   fp_;
 
+    // The block buffer, the number of bytes of file data it can hold, and
+    // the range of it that hasn't been consumed yet
+    uint8_t* block_;
+    size_t  block_capacity_;
+    size_t  block_pos_, block_end_;
+
+    // The block buffer is either this...
+    std::vector<uint8_t> block_storage_;
+
+    // ...which is charged against this budget, if we have one...
+    CMemoryBudget* budget_;
+
+    // With a budget, the file's stdio buffer is this, so that we know what 
+    // to charge for it
+    std::vector<char> stream_buffer_;
+
+    // ...or a block from this pool.  If the pool is one we created ourselves
+    // it's owned by own_pool_, which must outlive pool_block_.
+    CBlockPool* pool_;
+    std::unique_ptr<CBlockPool> own_pool_;
+    CBlockRef   pool_block_;
+
+    // True once the block-based functions have been used on this file
+    bool    block_mode_;
+
+    // The length of the most recent packet that returned bad_length
+    uint32_t bad_length_;
+
+    // The file offset of the last corrupt record counted
+    uint64_t corrupt_offset_;
+
+    // Checks whether every record in the file is the same size, and sets
+    // stride_ accordingly
+    void    detect_stride();
+
+    // The distance between records, if it's constant, or 0
+    uint32_t stride_;
+
     // This is the PCAP file header that was read in
     pcap_header_t header_;
 
+    // What we've done so far
+    counters_t counters_;
+
+    // For bytes_behind(): the file descriptor of the open file (or -1), and
+    // the offset in the file that we've read up to
+    std::atomic<int>      fd_{-1};
+    std::atomic<uint64_t> read_offset_{0};
+
 };
 //=============================================================================
 
 
+//=============================================================================
+// take_record() - If the block contains a complete packet, fills in a view
+//                 of it and moves past it.  This is the inner loop of every
+//                 block-based read, so it lives here where it can be inlined.
+//
+// Returns pcap_status_t::truncated if the block doesn't hold a complete
+// packet
+//=============================================================================
+inline pcap_status_t CPcapReader::take_record(packet_view_t* view) noexcept
+{
+    // If we don't have a full packet header available, tell the caller
+    size_t available = block_end_ - block_pos_;
+    if (available < 16) return pcap_status_t::truncated;
+
+    // Fetch the packet header
+    const uint8_t* record = block_ + block_pos_;
+    uint32_t field[4];
+    memcpy(field, record, sizeof(field));
+
+    // If the packet data won't fit into a pcap_packet_t, something is awry.
+    if (field[2] > sizeof(pcap_packet_t::data))
+    {
+        note_corrupt(field[2], read_offset_.load(std::memory_order_relaxed) - available);
+        return pcap_status_t::bad_length;
+    }
 
+    // If we don't have all of the packet data, tell the caller
+    if (available < 16 + field[2]) return pcap_status_t::truncated;
+
+    // Fill in the caller's view of the packet
+    view->ts_seconds     = field[0];
+    view->ts_nanoseconds = field[1];
+    view->length         = field[2];
+    view->data           = record + 16;
+    PCAPREADER_PROBE3(packet_read, field[2], field[0], field[1]);
+
+    // And move on to the next packet
+    block_pos_ += 16 + field[2];
+    bump(counters_.packets, 1);
+    bump(counters_.bytes, field[2]);
+    return pcap_status_t::ok;
+}
+//=============================================================================
@@ -0,0 +1,200 @@
+//=============================================================================
+// pcap_reader_c.cpp - A C interface to CPcapReader
+//=============================================================================
+#include <cstdio>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include "pcap_reader.h"
+#include "packet_parse.h"
+#include "header_columns.h"
+#include "pcap_reader_c.h"
+
+using namespace std;
+
+// The C structures are handed straight to the C++ code, so they had better
+// be laid out identically
+static_assert(sizeof(pcapr_packet_t) == sizeof(packet_view_t), "pcapr_packet_t layout");
+static_assert(offsetof(pcapr_packet_t, data) == offsetof(packet_view_t, data), "pcapr_packet_t layout");
+static_assert(sizeof(pcapr_eth_header_t) == sizeof(eth_header_t), "pcapr_eth_header_t layout");
+static_assert(offsetof(pcapr_eth_header_t, rdmx_target) == offsetof(eth_header_t, rdmx_target), 
+              "pcapr_eth_header_t layout");
+static_assert((int)PCAPR_IO_ERROR == (int)pcap_status_t::io_error, "pcapr_status_t values");
+static_assert((int)PCAPR_OUT_OF_MEMORY == (int)pcap_status_t::out_of_memory, "pcapr_status_t values");
+
+
+//=============================================================================
+// This is what a pcapr_reader_t really is
+//=============================================================================
+struct pcapr_reader
+{
+    CPcapReader     reader;
+
+    // Used by pcapr_next_columns()
+    CPacketBatch    batch;
+    CHeaderColumns  columns;
+};
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_open() - Opens a PCAP file
+//=============================================================================
+pcapr_reader_t* pcapr_open(const char* filename, char* errbuf, size_t errbuf_size)
+{
+    pcapr_reader_t* handle = new (nothrow) pcapr_reader;
+    if (handle == nullptr)
+    {
+        if (errbuf) snprintf(errbuf, errbuf_size, "Out of memory");
+        return nullptr;
+    }
+
+    try
+    {
+        handle->reader.open(filename);
+    }
+    catch(const exception& e)
+    {
+        if (errbuf) snprintf(errbuf, errbuf_size, "%s", e.what());
+        delete handle;
+        return nullptr;
+    }
+
+    return handle;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_close() - Closes the file and frees the reader
+//=============================================================================
+void pcapr_close(pcapr_reader_t* handle)
+{
+    delete handle;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_next() - Fetches a view of the next packet
+//=============================================================================
+pcapr_status_t pcapr_next(pcapr_reader_t* handle, pcapr_packet_t* packet)
+{
+    if (handle == nullptr) return PCAPR_NOT_OPEN;
+    return (pcapr_status_t)handle->reader.try_get_next_view((packet_view_t*)packet);
+}
+//=============================================================================
+
+
+//=============================================================================
+// fill_views() - Fetches views of up to "max_packets" packets.  Only the 
+//                first packet can cause a refill of the reader's block, so 
+//                all of the views stay valid together.
+//=============================================================================
+static pcap_status_t fill_views(CPcapReader& reader, packet_view_t* views,
+                                size_t max_packets, size_t* count)
+{
+    *count = 0;
+    if (max_packets == 0) return pcap_status_t::ok;
+
+    // Fetch the first packet, refilling the block if need be
+    pcap_status_t status = reader.try_get_next_view(&views[0]);
+    if (status != pcap_status_t::ok) return status;
+
+    // Then take whatever else is already in the block
+    size_t n = 1;
+    while (n < max_packets && reader.try_get_buffered_view(&views[n]) == pcap_status_t::ok) ++n;
+
+    *count = n;
+    return pcap_status_t::ok;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_next_batch() - Fetches views of up to "max_packets" packets
+//=============================================================================
+pcapr_status_t pcapr_next_batch(pcapr_reader_t* handle, pcapr_packet_t* packets,
+                                size_t max_packets, size_t* count)
+{
+    *count = 0;
+    if (handle == nullptr) return PCAPR_NOT_OPEN;
+    return (pcapr_status_t)fill_views(handle->reader, (packet_view_t*)packets, max_packets, count);
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_next_columns() - Fetches up to "max_packets" packets and parses 
+//                        their headers into columns
+//=============================================================================
+pcapr_status_t pcapr_next_columns(pcapr_reader_t* handle, size_t max_packets,
+                                  pcapr_columns_t* out)
+{
+    out->count = 0;
+    if (handle == nullptr) return PCAPR_NOT_OPEN;
+
+    // Make sure the batch can hold as many packets as the caller wants
+    CPacketBatch& batch = handle->batch;
+    if (batch.capacity() != max_packets) batch = CPacketBatch(max_packets);
+
+    // Fetch the packets
+    size_t count;
+    pcap_status_t status = fill_views(handle->reader, batch.views(), max_packets, &count);
+    batch.set_size(count);
+    if (status != pcap_status_t::ok) return (pcapr_status_t)status;
+
+    // Parse them into columns, and point the caller at the columns
+    CHeaderColumns& columns = handle->columns;
+    columns.decode(batch);
+
+    out->count          = columns.size();
+    out->data_base      = columns.data_base();
+    out->data_span      = columns.data_span();
+    out->layers         = columns.layers.data();
+    out->ts_seconds     = columns.ts_seconds.data();
+    out->ts_nanoseconds = columns.ts_nanoseconds.data();
+    out->length         = columns.length.data();
+    out->data_offset    = columns.data_offset.data();
+    out->eth_type       = columns.eth_type.data();
+    out->ip4_protocol   = columns.ip4_protocol.data();
+    out->ip4_src_ip     = columns.ip4_src_ip.data();
+    out->ip4_dst_ip     = columns.ip4_dst_ip.data();
+    out->udp_src_port   = columns.udp_src_port.data();
+    out->udp_dst_port   = columns.udp_dst_port.data();
+    out->udp_length     = columns.udp_length.data();
+    out->rdmx_target    = columns.rdmx_target.data();
+    return PCAPR_OK;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_skip_bad_record() - Moves past a packet that reported a bad length
+//=============================================================================
+pcapr_status_t pcapr_skip_bad_record(pcapr_reader_t* handle)
+{
+    if (handle == nullptr) return PCAPR_NOT_OPEN;
+    return (pcapr_status_t)handle->reader.skip_bad_record();
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_parse_headers() - Parses the headers of a packet into fields
+//=============================================================================
+void pcapr_parse_headers(const uint8_t* data, pcapr_eth_header_t* header)
+{
+    parse_headers<parse_depth_t::rdmx>(data, (eth_header_t*)header);
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcapr_status_string() - Returns a description of a status
+//=============================================================================
+const char* pcapr_status_string(pcapr_status_t status)
+{
+    return pcap_status_string((pcap_status_t)status);
+}
+//=============================================================================
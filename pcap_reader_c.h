@@ -0,0 +1,131 @@
+/*=============================================================================
+ pcap_reader_c.h - A C interface to CPcapReader, for programs (and other 
+                   languages) that can't use the C++ class directly.
+
+ The functions that read packets never fail by throwing.  They return a
+ pcapr_status_t instead.
+=============================================================================*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An open PCAP file */
+typedef struct pcapr_reader pcapr_reader_t;
+
+/* A view of a packet.  The data stays valid until the next read */
+typedef struct
+{
+    uint32_t        ts_seconds;
+    uint32_t        ts_nanoseconds;
+    uint32_t        length;
+    const uint8_t*  data;
+} pcapr_packet_t;
+
+/* The outcome of a read.  These match pcap_status_t */
+typedef enum
+{
+    PCAPR_OK,
+    PCAPR_EOF,
+    PCAPR_TRUNCATED,
+    PCAPR_BAD_LENGTH,
+    PCAPR_NOT_OPEN,
+    PCAPR_IO_ERROR,
+    PCAPR_OUT_OF_MEMORY
+} pcapr_status_t;
+
+/* Fields broken out from an Ethernet/IPv4/UDP/RDMX packet.  This has the 
+   same layout as the C++ eth_header_t */
+typedef struct
+{
+    uint8_t     is_ethernet;
+    uint8_t     is_ipv4;
+    uint8_t     is_udp;
+    uint8_t     is_rdmx;
+
+    uint8_t     eth_dst_mac[6];
+    uint8_t     eth_src_mac[6];
+    uint16_t    eth_type;
+    
+    uint8_t     ip4_version;
+    uint8_t     ip4_dsf;
+    uint16_t    ip4_length;
+    uint16_t    ip4_id;
+    uint16_t    ip4_flags;
+    uint8_t     ip4_ttl;
+    uint8_t     ip4_protocol;
+    uint16_t    ip4_checksum;
+    uint32_t    ip4_src_ip;
+    uint32_t    ip4_dst_ip;
+
+    uint16_t    udp_src_port;
+    uint16_t    udp_dst_port;
+    uint16_t    udp_length;
+    uint16_t    udp_checksum;
+
+    uint16_t    rdmx_magic;
+    uint64_t    rdmx_target;
+} pcapr_eth_header_t;
+
+/* The parsed headers of a batch of packets, one array per field.  The data
+   of packet "i" is "length[i]" bytes at data_base + data_offset[i].  All of 
+   these pointers stay valid until the next read.  "layers" is how many 
+   layers of the packet were recognized: 0 = none, 1 = Ethernet, 2 = IPv4, 
+   3 = UDP, 4 = RDMX */
+typedef struct
+{
+    size_t          count;
+    const uint8_t*  data_base;
+    size_t          data_span;
+
+    const uint8_t*  layers;
+    const uint32_t* ts_seconds;
+    const uint32_t* ts_nanoseconds;
+    const uint32_t* length;
+    const uint32_t* data_offset;
+
+    const uint16_t* eth_type;
+    const uint8_t*  ip4_protocol;
+    const uint32_t* ip4_src_ip;
+    const uint32_t* ip4_dst_ip;
+    const uint16_t* udp_src_port;
+    const uint16_t* udp_dst_port;
+    const uint16_t* udp_length;
+    const uint64_t* rdmx_target;
+} pcapr_columns_t;
+
+/* Opens a PCAP file.  Returns NULL on failure, with the reason in "errbuf"
+   (if it isn't NULL) */
+pcapr_reader_t* pcapr_open(const char* filename, char* errbuf, size_t errbuf_size);
+
+/* Closes the file and frees the reader */
+void            pcapr_close(pcapr_reader_t* reader);
+
+/* Fetches the next packet */
+pcapr_status_t  pcapr_next(pcapr_reader_t* reader, pcapr_packet_t* packet);
+
+/* Fetches up to "max_packets" packets at once, and stores how many were 
+   fetched in "count".  Returns PCAPR_OK if at least one packet was fetched */
+pcapr_status_t  pcapr_next_batch(pcapr_reader_t* reader, pcapr_packet_t* packets,
+                                 size_t max_packets, size_t* count);
+
+/* Fetches up to "max_packets" packets and parses their headers into 
+   columns.  Returns PCAPR_OK if at least one packet was fetched */
+pcapr_status_t  pcapr_next_columns(pcapr_reader_t* reader, size_t max_packets,
+                                   pcapr_columns_t* columns);
+
+/* After PCAPR_BAD_LENGTH, moves past the bad packet */
+pcapr_status_t  pcapr_skip_bad_record(pcapr_reader_t* reader);
+
+/* Parses the headers of a packet into fields */
+void            pcapr_parse_headers(const uint8_t* data, pcapr_eth_header_t* header);
+
+/* Returns a description of a status */
+const char*     pcapr_status_string(pcapr_status_t status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,282 @@
+//=============================================================================
+// pcap_set_reader.cpp - Reads a set of rotated PCAP files as though they
+//                       were one continuous file.
+//=============================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <cstdarg>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include "pcap_set_reader.h"
+#include "usdt_probes.h"
+
+using namespace std;
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// open_ahead() - Opens a PCAP file.  This runs in a background thread while
+//                the previous file in the set is still being read.  If the
+//                budget is exhausted, it waits for the memory here.
+//=============================================================================
+static unique_ptr<CPcapReader> open_ahead(string filename, CMemoryBudget* budget)
+{
+    // Ask the kernel to start pulling the file into the page cache
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+
+    // Open the file and read in its PCAP header
+    unique_ptr<CPcapReader> reader(new CPcapReader);
+    reader->set_memory_budget(budget);
+    reader->open(filename);
+    return reader;
+}
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CPcapSetReader::CPcapSetReader()
+{
+    is_glob_ = false;
+    index_   = -1;
+    follow_  = false;
+    poll_ms_ = 100;
+    stop_    = false;
+    budget_  = nullptr;
+}
+//=============================================================================
+
+
+//=============================================================================
+// open() - Opens a rotation set and its first file
+//=============================================================================
+void CPcapSetReader::open(string name, bool follow)
+{
+    // Make sure we're not holding onto a previous set
+    close();
+
+    set_name_ = name;
+    is_glob_  = (name.find_first_of("*?[") != string::npos);
+    index_    = -1;
+    follow_   = follow;
+    stop_     = false;
+
+    // Find the first file of the set
+    start_read_ahead();
+
+    // If there is no first file, that's only OK if we're going to wait for it
+    if (!next_.valid() && !follow_) throwRuntime("No files match %s", name.c_str());
+
+    // Open the first file
+    advance();
+}
+//=============================================================================
+
+
+//=============================================================================
+// close() - Closes the current file and discards any read-ahead
+//=============================================================================
+void CPcapSetReader::close()
+{
+    // Give back the current file's memory first, in case a read-ahead is 
+    // waiting for it
+    retire(nullptr);
+    current_name_.clear();
+
+    // If a read-ahead is in flight, wait for it and throw away the result
+    if (next_.valid()) next_.wait();
+    next_ = future<unique_ptr<CPcapReader>>();
+    next_name_.clear();
+}
+//=============================================================================
+
+
+//=============================================================================
+// find_next_file() - Returns the name of the file that follows the current
+//                    one, or an empty string if it doesn't exist (yet).
+//=============================================================================
+string CPcapSetReader::find_next_file()
+{
+    // In numeric mode, the next file is just the next number in sequence
+    if (!is_glob_)
+    {
+        string filename = set_name_ + to_string(index_ + 1);
+        return (access(filename.c_str(), F_OK) == 0) ? filename : "";
+    }
+
+    // In glob mode, the next file is the first match that sorts after the 
+    // current file.  glob() hands the matches back in sorted order.
+    string result;
+    glob_t matches;
+    if (glob(set_name_.c_str(), 0, nullptr, &matches) == 0)
+    {
+        for (size_t i=0; i<matches.gl_pathc; ++i)
+        {
+            string filename = matches.gl_pathv[i];
+            if (current_name_.empty() || filename > current_name_)
+            {
+                result = filename;
+                break;
+            }
+        }
+    }
+    globfree(&matches);
+    return result;
+}
+//=============================================================================
+
+
+//=============================================================================
+// start_read_ahead() - If the next file of the set exists, start opening it
+//                      in the background
+//=============================================================================
+void CPcapSetReader::start_read_ahead()
+{
+    // If we're already opening the next file, don't do it again
+    if (next_.valid()) return;
+
+    // Find out if there is a next file
+    string filename = find_next_file();
+    if (filename.empty()) return;
+
+    // Start opening it in the background
+    next_name_ = filename;
+    next_ = async(launch::async, open_ahead, filename, budget_);
+}
+//=============================================================================
+
+
+//=============================================================================
+// advance() - Switches to the next file in the set.
+//
+// Returns 'true' if we're now reading a new file
+//=============================================================================
+bool CPcapSetReader::advance()
+{
+    // If the next file doesn't exist yet, we can't advance to it
+    if (!next_.valid()) return false;
+
+    // We're done with the current file.  Let it go before waiting for the
+    // next one, whose buffer may be waiting for the memory it holds.
+    retire(nullptr);
+
+    // Fetch the reader that was opened in the background.  In follow mode,
+    // the file may exist but not have a complete PCAP header yet, in which
+    // case we'll try again later.
+    unique_ptr<CPcapReader> reader;
+    try
+    {
+        reader = next_.get();
+    }
+    catch(const runtime_error&)
+    {
+        if (!follow_) throw;
+        return false;
+    }
+
+    // The newly opened file is now our current file
+    retire(move(reader));
+    current_name_ = next_name_;
+    ++index_;
+
+    // And start opening the file after it
+    start_read_ahead();
+    return true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// retire() - Replaces the current reader, keeping a tally of the counters of
+//            the one it replaces
+//=============================================================================
+void CPcapSetReader::retire(unique_ptr<CPcapReader> replacement)
+{
+    lock_guard<mutex> lock(current_mutex_);
+    if (current_) finished_ += current_->stats();
+    current_ = move(replacement);
+}
+//=============================================================================
+
+
+//=============================================================================
+// stats() - Adds up the counters of every file read so far
+//=============================================================================
+pcap_reader_stats_t CPcapSetReader::stats()
+{
+    lock_guard<mutex> lock(current_mutex_);
+    pcap_reader_stats_t result = finished_;
+    if (current_) result += current_->stats();
+    return result;
+}
+//=============================================================================
+
+
+//=============================================================================
+// bytes_behind() - Returns how much of the current file is still unread
+//=============================================================================
+uint64_t CPcapSetReader::bytes_behind()
+{
+    lock_guard<mutex> lock(current_mutex_);
+    return current_ ? current_->bytes_behind() : 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// get_next_packet() - Fetches the next packet from the set.
+//
+// Returns 'true' on success, or 'false' if no more packets are available
+//=============================================================================
+bool CPcapSetReader::get_next_packet(pcap_packet_t* packet)
+{
+    while (true)
+    {
+        // If the current file has a packet for us, we're done
+        if (current_ && current_->get_next_packet(packet)) return true;
+
+        // If we don't yet know of a file after this one, check again
+        start_read_ahead();
+
+        // Once the next file exists the writer is done with the current one,
+        // but it may have written a final few packets before rotating.  Give
+        // the current file one last look before moving on.
+        if (next_.valid())
+        {
+            if (current_ && current_->get_next_packet(packet)) return true;
+            if (advance()) continue;
+        }
+
+        // If we're not following a growing set, this is the end of the data
+        if (!follow_ || stop_) return false;
+
+        // Wait for the set to grow
+        PCAPREADER_PROBE1(follow_stall, poll_ms_);
+        this_thread::sleep_for(chrono::milliseconds(poll_ms_));
+        if (stop_) return false;
+    }
+}
+//=============================================================================
@@ -0,0 +1,125 @@
+//=============================================================================
+// pcap_set_reader.h - Reads a set of rotated PCAP files as though they were
+//                     one continuous file.
+//
+// A rotation set can be named two ways:
+//
+//   "cap.pcap"          - Numeric rotation.  The files are cap.pcap0,
+//                         cap.pcap1, cap.pcap2, etc.
+//
+//   "cap-*.pcap"        - Any name containing glob characters.  The files
+//                         are every match, read in sorted order.  This is
+//                         the form to use with strftime-style names such as
+//                         cap-20191208-153000.pcap
+//
+// While one file is being read, the next file in the set is opened in the
+// background so that there is no stall at the file boundary.
+//
+// In "follow" mode, reaching the end of the newest file doesn't end the
+// stream: the reader waits for more packets to be written to that file, or
+// for the next file in the set to appear.
+//=============================================================================
+#pragma once
+#include <string>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include "pcap_reader.h"
+#include "memory_budget.h"
+
+
+class CPcapSetReader
+{
+public:
+
+    // Constructor / destructor
+    CPcapSetReader();
+    ~CPcapSetReader() {close();}
+
+    // Call this to open a rotation set.  When "follow" is true, the reader
+    // will wait for the set to grow rather than reporting end-of-data.
+    // Will throw std::runtime_error on failure.
+    void    open(std::string name, bool follow = false);
+
+    // This fetches the next packet from the set.  Returns false when there
+    // are no more packets available to read, or when stop() is called.
+    // Will throw std::runtime_error on failure.
+    bool    get_next_packet(pcap_packet_t*);
+
+    // In follow mode, this is how long to sleep between checks for new data
+    void    set_poll_interval(int milliseconds) {poll_ms_ = milliseconds;}
+
+    // Charges the buffers of every file in the set, including the one being
+    // opened ahead, against "budget" (see CPcapReader::set_memory_budget()).
+    // Call this before open().
+    void    set_memory_budget(CMemoryBudget* budget) {budget_ = budget;}
+
+    // Makes a get_next_packet() that is waiting in follow mode return false.
+    // Safe to call from any thread.
+    void    stop() {stop_ = true;}
+
+    // Call this to close the current file and cancel any read-ahead
+    void    close();
+
+    // Returns the name of the file currently being read
+    std::string current_file() {return current_name_;}
+
+    // Fetches the counters of every file read so far, added together.
+    // Safe to call from any thread.
+    pcap_reader_stats_t stats();
+
+    // Returns how far the reader is behind the end of the file it's reading
+    // (see CPcapReader::bytes_behind()).  Safe to call from any thread.
+    uint64_t bytes_behind();
+
+protected:
+
+    // Returns the name of the file that comes after current_name_, or ""
+    // if no such file exists yet
+    std::string find_next_file();
+
+    // Starts opening the next file in the set in the background
+    void    start_read_ahead();
+
+    // Switches to the next file in the set.  Returns false if there isn't one
+    bool    advance();
+
+    // Makes "replacement" the current reader
+    void    retire(std::unique_ptr<CPcapReader> replacement);
+
+    // True if the set name contains glob characters
+    bool    is_glob_;
+
+    // The name we were opened with
+    std::string set_name_;
+
+    // In numeric mode, the index of the file currently being read
+    int     index_;
+
+    // Should we wait for more data at the end of the set?
+    bool    follow_;
+
+    // How long to sleep between checks for new data in follow mode
+    int     poll_ms_;
+
+    // Set by stop() to end a follow
+    std::atomic<bool> stop_;
+
+    // The file we're currently reading.  The mutex is held while it's 
+    // replaced, so that stats() can safely look at it.
+    std::unique_ptr<CPcapReader> current_;
+    std::string current_name_;
+    std::mutex  current_mutex_;
+
+    // The counters of the files we've finished with
+    pcap_reader_stats_t finished_;
+
+    // The next file in the set, being opened in the background
+    std::future<std::unique_ptr<CPcapReader>> next_;
+    std::string next_name_;
+
+    // What the readers' buffers are charged against, if anything
+    CMemoryBudget* budget_;
+};
+//=============================================================================
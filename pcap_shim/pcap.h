@@ -0,0 +1,129 @@
+/*=============================================================================
+ pcap.h - The part of the libpcap API that reads capture files, implemented
+          on top of CPcapReader.
+
+ Programs that only read capture files through the functions below can be
+ rebuilt against this header and linked with libpcapshim in place of
+ libpcap, with no source changes:
+
+    g++ -Ipcap_shim tool.cpp -L. -lpcapshim -pthread
+
+ The declarations match libpcap's, so the shim is also binary compatible
+ with programs that were linked against libpcap.so and use only these
+ functions.
+
+ Differences from libpcap:
+
+   - Only little-endian files are read, and packets may be no larger than
+     CPcapReader allows (10000 bytes).  pcap_open_offline() fails on
+     anything else.
+
+   - pcap_file() returns NULL, because the file isn't read through a stdio
+     stream that the caller could use.
+=============================================================================*/
+#pragma once
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCAP_VERSION_MAJOR  2
+#define PCAP_VERSION_MINOR  4
+
+#define PCAP_ERRBUF_SIZE    256
+
+/* Return values */
+#define PCAP_ERROR          -1      /* generic error code */
+#define PCAP_ERROR_BREAK    -2      /* loop terminated by pcap_breakloop, or end of file */
+
+/* Timestamp precisions, for pcap_open_offline_with_tstamp_precision() */
+#define PCAP_TSTAMP_PRECISION_MICRO 0
+#define PCAP_TSTAMP_PRECISION_NANO  1
+
+/* The link type of Ethernet captures */
+#define DLT_EN10MB          1
+
+typedef unsigned int bpf_u_int32;
+
+/* An open capture file */
+typedef struct pcap pcap_t;
+
+/* The header of a capture file */
+struct pcap_file_header
+{
+    bpf_u_int32     magic;
+    unsigned short  version_major;
+    unsigned short  version_minor;
+    int             thiszone;
+    bpf_u_int32     sigfigs;
+    bpf_u_int32     snaplen;
+    bpf_u_int32     linktype;
+};
+
+/* The header of each packet.  "ts.tv_usec" holds nanoseconds when the file
+   was opened with PCAP_TSTAMP_PRECISION_NANO */
+struct pcap_pkthdr
+{
+    struct timeval  ts;
+    bpf_u_int32     caplen;     /* length of the data that was captured */
+    bpf_u_int32     len;        /* length of the packet on the wire */
+};
+
+/* The callback used by pcap_loop() and pcap_dispatch() */
+typedef void (*pcap_handler)(u_char* user, const struct pcap_pkthdr* header, const u_char* data);
+
+/* Opens a capture file with microsecond timestamps.  Returns NULL on
+   failure, with the reason in "errbuf" */
+pcap_t*     pcap_open_offline(const char* filename, char* errbuf);
+
+/* Opens a capture file, with timestamps at the given precision */
+pcap_t*     pcap_open_offline_with_tstamp_precision(const char* filename, u_int precision, char* errbuf);
+
+/* Closes the file and frees the handle */
+void        pcap_close(pcap_t* p);
+
+/* Fetches the next packet.  The header and data stay valid until the next
+   read.  Returns 1 on success, PCAP_ERROR_BREAK at the end of the file, or
+   PCAP_ERROR on failure */
+int         pcap_next_ex(pcap_t* p, struct pcap_pkthdr** header, const u_char** data);
+
+/* Fetches the next packet, or returns NULL at the end of the file or on
+   failure */
+const u_char* pcap_next(pcap_t* p, struct pcap_pkthdr* header);
+
+/* Calls "callback" for up to "count" packets (or every packet, if "count"
+   is zero or less).  Returns 0 when done, PCAP_ERROR on failure, or
+   PCAP_ERROR_BREAK if pcap_breakloop() was called */
+int         pcap_loop(pcap_t* p, int count, pcap_handler callback, u_char* user);
+
+/* Calls "callback" for up to "count" packets (or every packet, if "count"
+   is zero or -1).  Returns the number of packets processed (0 at the end
+   of the file), PCAP_ERROR on failure, or PCAP_ERROR_BREAK if
+   pcap_breakloop() was called before any packets were processed */
+int         pcap_dispatch(pcap_t* p, int count, pcap_handler callback, u_char* user);
+
+/* Makes pcap_loop() or pcap_dispatch() return PCAP_ERROR_BREAK, typically
+   from inside the callback */
+void        pcap_breakloop(pcap_t* p);
+
+/* Information about the open file */
+int         pcap_datalink(pcap_t* p);
+int         pcap_snapshot(pcap_t* p);
+int         pcap_major_version(pcap_t* p);
+int         pcap_minor_version(pcap_t* p);
+int         pcap_is_swapped(pcap_t* p);
+int         pcap_get_tstamp_precision(pcap_t* p);
+FILE*       pcap_file(pcap_t* p);
+
+/* Returns the description of the most recent error */
+char*       pcap_geterr(pcap_t* p);
+
+/* Returns a description of the library */
+const char* pcap_lib_version(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,272 @@
+//=============================================================================
+// pcap_shim.cpp - The part of the libpcap API that reads capture files,
+//                 implemented on top of CPcapReader
+//
+// Packets are fetched with the block-based views, so nothing is copied:
+// the data handed to the caller points straight into the reader's block,
+// and stays valid until the next read, just as libpcap promises.
+//=============================================================================
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include <stdexcept>
+#include "pcap_reader.h"
+#include "pcap.h"
+
+using namespace std;
+
+
+//=============================================================================
+// This is what a pcap_t really is
+//=============================================================================
+struct pcap
+{
+    CPcapReader         reader;
+
+    // Does the file hold nanosecond timestamps, and does the caller want
+    // them?
+    bool                file_nanoseconds;
+    bool                want_nanoseconds;
+
+    // Set by pcap_breakloop()
+    std::atomic<bool>   break_loop{false};
+
+    // The header handed back by pcap_next_ex()
+    pcap_pkthdr         header;
+
+    // The most recent error
+    char                errbuf[PCAP_ERRBUF_SIZE];
+};
+//=============================================================================
+
+
+//=============================================================================
+// next_record() - Fetches the next packet and fills in p->header.
+//
+// Returns 1 on success, PCAP_ERROR_BREAK at the end of the file, or
+// PCAP_ERROR on failure
+//=============================================================================
+static int next_record(pcap_t* p, const u_char** data)
+{
+    packet_view_t view;
+    pcap_status_t status = p->reader.try_get_next_view(&view);
+
+    switch (status)
+    {
+        case pcap_status_t::ok:
+            break;
+
+        case pcap_status_t::eof:
+            return PCAP_ERROR_BREAK;
+
+        case pcap_status_t::truncated:
+            snprintf(p->errbuf, sizeof(p->errbuf), "truncated dump file");
+            return PCAP_ERROR;
+
+        case pcap_status_t::bad_length:
+            snprintf(p->errbuf, sizeof(p->errbuf), "invalid packet capture length");
+            return PCAP_ERROR;
+
+        default:
+            snprintf(p->errbuf, sizeof(p->errbuf), "error reading dump file");
+            return PCAP_ERROR;
+    }
+
+    // Convert the timestamp to the precision the caller asked for
+    uint32_t fraction = view.ts_nanoseconds;
+    if (p->file_nanoseconds && !p->want_nanoseconds) fraction /= 1000;
+    if (!p->file_nanoseconds && p->want_nanoseconds) fraction *= 1000;
+
+    // The view doesn't carry the original length, but the packet's record
+    // header sits in the block just ahead of the data, so fetch it from there
+    uint32_t original_length;
+    memcpy(&original_length, view.data - 4, sizeof(original_length));
+
+    p->header.ts.tv_sec  = view.ts_seconds;
+    p->header.ts.tv_usec = fraction;
+    p->header.caplen     = view.length;
+    p->header.len        = original_length;
+    *data = view.data;
+    return 1;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_open_offline_with_tstamp_precision() - Opens a capture file
+//=============================================================================
+pcap_t* pcap_open_offline_with_tstamp_precision(const char* filename, u_int precision, char* errbuf)
+{
+    if (precision != PCAP_TSTAMP_PRECISION_MICRO && precision != PCAP_TSTAMP_PRECISION_NANO)
+    {
+        if (errbuf) snprintf(errbuf, PCAP_ERRBUF_SIZE, "unknown time stamp resolution %u", precision);
+        return nullptr;
+    }
+
+    pcap_t* p = new (nothrow) pcap;
+    if (p == nullptr)
+    {
+        if (errbuf) snprintf(errbuf, PCAP_ERRBUF_SIZE, "Out of memory");
+        return nullptr;
+    }
+
+    try
+    {
+        p->reader.open(filename);
+    }
+    catch(const exception& e)
+    {
+        if (errbuf) snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", e.what());
+        delete p;
+        return nullptr;
+    }
+
+    p->file_nanoseconds = p->reader.is_nanosecond();
+    p->want_nanoseconds = (precision == PCAP_TSTAMP_PRECISION_NANO);
+    p->errbuf[0] = 0;
+    return p;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_open_offline() - Opens a capture file with microsecond timestamps
+//=============================================================================
+pcap_t* pcap_open_offline(const char* filename, char* errbuf)
+{
+    return pcap_open_offline_with_tstamp_precision(filename, PCAP_TSTAMP_PRECISION_MICRO, errbuf);
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_close() - Closes the file and frees the handle
+//=============================================================================
+void pcap_close(pcap_t* p)
+{
+    delete p;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_next_ex() - Fetches the next packet
+//=============================================================================
+int pcap_next_ex(pcap_t* p, struct pcap_pkthdr** header, const u_char** data)
+{
+    *header = &p->header;
+    return next_record(p, data);
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_next() - Fetches the next packet, or NULL if there isn't one
+//=============================================================================
+const u_char* pcap_next(pcap_t* p, struct pcap_pkthdr* header)
+{
+    const u_char* data;
+    if (next_record(p, &data) != 1) return nullptr;
+    *header = p->header;
+    return data;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_dispatch() - Calls "callback" for up to "count" packets
+//=============================================================================
+int pcap_dispatch(pcap_t* p, int count, pcap_handler callback, u_char* user)
+{
+    int processed = 0;
+
+    while (count <= 0 || processed < count)
+    {
+        // If we've been told to stop, say so unless we've processed packets
+        if (p->break_loop.load(memory_order_relaxed))
+        {
+            if (processed) return processed;
+            p->break_loop = false;
+            return PCAP_ERROR_BREAK;
+        }
+
+        const u_char* data;
+        int rc = next_record(p, &data);
+        if (rc == PCAP_ERROR_BREAK) break;
+        if (rc == PCAP_ERROR) return PCAP_ERROR;
+
+        callback(user, &p->header, data);
+        ++processed;
+    }
+
+    return processed;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_loop() - Calls "callback" for up to "count" packets.  Reading a file,
+//               this is pcap_dispatch() that only stops at the end.
+//=============================================================================
+int pcap_loop(pcap_t* p, int count, pcap_handler callback, u_char* user)
+{
+    int remaining = count;
+
+    while (true)
+    {
+        int rc = pcap_dispatch(p, (count <= 0) ? -1 : remaining, callback, user);
+        if (rc < 0) return rc;
+        if (rc == 0) return 0;
+        if (count > 0 && (remaining -= rc) <= 0) return 0;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_breakloop() - Makes pcap_loop() or pcap_dispatch() stop
+//=============================================================================
+void pcap_breakloop(pcap_t* p)
+{
+    p->break_loop = true;
+}
+//=============================================================================
+
+
+//=============================================================================
+// Information about the open file
+//=============================================================================
+int pcap_datalink(pcap_t* p)      {return p->reader.file_header().link_type;}
+int pcap_snapshot(pcap_t* p)      {return p->reader.file_header().snaplen;}
+int pcap_major_version(pcap_t* p) {return p->reader.file_header().major_version;}
+int pcap_minor_version(pcap_t* p) {return p->reader.file_header().minor_version;}
+int pcap_is_swapped(pcap_t*)      {return 0;}
+FILE* pcap_file(pcap_t*)          {return nullptr;}
+
+int pcap_get_tstamp_precision(pcap_t* p)
+{
+    return p->want_nanoseconds ? PCAP_TSTAMP_PRECISION_NANO : PCAP_TSTAMP_PRECISION_MICRO;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_geterr() - Returns the description of the most recent error
+//=============================================================================
+char* pcap_geterr(pcap_t* p)
+{
+    return p->errbuf;
+}
+//=============================================================================
+
+
+//=============================================================================
+// pcap_lib_version() - Returns a description of the library
+//=============================================================================
+const char* pcap_lib_version()
+{
+    return "pcapreader libpcap shim (libpcap 1.x compatible file-reading API)";
+}
+//=============================================================================
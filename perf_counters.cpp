@@ -0,0 +1,190 @@
+//=============================================================================
+// perf_counters.cpp - Hardware performance counters via perf_event_open()
+//=============================================================================
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <cstring>
+#include <cstdio>
+#include "perf_counters.h"
+
+using namespace std;
+
+
+//=============================================================================
+// The perf event type and config of each counter
+//=============================================================================
+static const struct {uint32_t type; uint64_t config; const char* name;} events[PERF_COUNTER_COUNT] =
+{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,    "cycles"      },
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,  "instructions"},
+    {
+        PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        "llc_misses"
+    },
+    {
+        PERF_TYPE_HW_CACHE, 
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        "dtlb_misses"
+    },
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses"},
+};
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CPerfCounters::CPerfCounters()
+{
+    for (int& fd : fd_) fd = -1;
+}
+//=============================================================================
+
+
+//=============================================================================
+// name() - Returns the short name of a counter
+//=============================================================================
+const char* CPerfCounters::name(perf_counter_t counter)
+{
+    return (counter < PERF_COUNTER_COUNT) ? events[counter].name : "unknown";
+}
+//=============================================================================
+
+
+//=============================================================================
+// open() - Opens every counter that's available
+//=============================================================================
+bool CPerfCounters::open()
+{
+    close();
+
+    for (int i=0; i<PERF_COUNTER_COUNT; ++i)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = events[i].type;
+        attr.config         = events[i].config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fd_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+
+    return is_open();
+}
+//=============================================================================
+
+
+//=============================================================================
+// is_open() - Returns true if any counter is open
+//=============================================================================
+bool CPerfCounters::is_open() const
+{
+    for (int fd : fd_) if (fd >= 0) return true;
+    return false;
+}
+//=============================================================================
+
+
+//=============================================================================
+// start() - Zeroes the counters and starts counting
+//=============================================================================
+void CPerfCounters::start()
+{
+    for (int fd : fd_) if (fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// stop() - Stops counting
+//=============================================================================
+void CPerfCounters::stop()
+{
+    for (int fd : fd_) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+}
+//=============================================================================
+
+
+//=============================================================================
+// read() - Fetches the counts.  If the kernel had more counters than it had
+//          hardware to count them with, each was only counting part of the
+//          time, and we scale it up to an estimate of the whole.
+//=============================================================================
+perf_counts_t CPerfCounters::read() const
+{
+    perf_counts_t counts;
+
+    for (int i=0; i<PERF_COUNTER_COUNT; ++i)
+    {
+        // The value, the time enabled and the time running
+        uint64_t data[3];
+        if (fd_[i] < 0 || ::read(fd_[i], data, sizeof(data)) != sizeof(data)) continue;
+
+        if (data[2] == 0) continue;
+        if (data[2] < data[1]) data[0] = (uint64_t)((double)data[0] * data[1] / data[2]);
+
+        counts.value[i] = data[0];
+        counts.available |= 1 << i;
+    }
+
+    return counts;
+}
+//=============================================================================
+
+
+//=============================================================================
+// close() - Closes the counters
+//=============================================================================
+void CPerfCounters::close()
+{
+    for (int& fd : fd_) if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// perf_summary() - Formats counts as per-packet costs
+//=============================================================================
+string perf_summary(const perf_counts_t& counts, uint64_t packets)
+{
+    static const char* labels[PERF_COUNTER_COUNT] =
+    {
+        "cycles/pkt", "instr/pkt", "llc_misses/pkt", "dtlb_misses/pkt", "branch_misses/pkt"
+    };
+
+    string result;
+    char text[64];
+    if (packets == 0) packets = 1;
+
+    for (int i=0; i<PERF_COUNTER_COUNT; ++i)
+    {
+        if (!counts.has((perf_counter_t)i)) continue;
+        snprintf(text, sizeof(text), "%s%s=%.2f", result.empty() ? "" : " ", labels[i], (double)counts.value[i] / packets);
+        result += text;
+
+        // Instructions per cycle goes right after the instruction count
+        if (i == PERF_INSTRUCTIONS && counts.has(PERF_CYCLES) && counts.value[PERF_CYCLES])
+        {
+            snprintf(text, sizeof(text), " ipc=%.2f", (double)counts.value[PERF_INSTRUCTIONS] / counts.value[PERF_CYCLES]);
+            result += text;
+        }
+    }
+
+    return result;
+}
+//=============================================================================
@@ -0,0 +1,109 @@
+//=============================================================================
+// perf_counters.h - Hardware performance counters for the calling thread,
+//                   read via perf_event_open()
+//
+// The counters are cycles, instructions, last-level cache misses, data TLB
+// misses and branch misses.  Each is opened separately, so a counter the
+// CPU or kernel doesn't support (or that perf_event_paranoid forbids) is
+// simply missing from the results rather than disabling the rest.  Only
+// user-space events are counted.
+//
+// Typical use:
+//
+//     CPerfCounters counters;
+//     counters.open();
+//     counters.start();
+//     ... read and parse packets ...
+//     counters.stop();
+//     printf("%s\n", perf_summary(counters.read(), packets).c_str());
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+//=============================================================================
+// The counters we know how to measure
+//=============================================================================
+enum perf_counter_t
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,        // Last-level cache read misses
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+//=============================================================================
+
+
+//=============================================================================
+// A set of counter values
+//=============================================================================
+struct perf_counts_t
+{
+    // The value of each counter, scaled up if the kernel had to multiplex it
+    uint64_t    value[PERF_COUNTER_COUNT] = {};
+
+    // Bit n is set if counter n was measured
+    uint32_t    available = 0;
+
+    bool has(perf_counter_t counter) const {return available & (1 << counter);}
+
+    perf_counts_t& operator+=(const perf_counts_t& rhs)
+    {
+        for (int i=0; i<PERF_COUNTER_COUNT; ++i) value[i] += rhs.value[i];
+        available |= rhs.available;
+        return *this;
+    }
+};
+//=============================================================================
+
+
+class CPerfCounters
+{
+public:
+
+    CPerfCounters();
+    ~CPerfCounters() {close();}
+
+    // Opens the counters for the calling thread.  Returns false if none of
+    // them are available.  This never throws: counters are a diagnostic,
+    // and their absence shouldn't stop anything from running.
+    bool    open();
+
+    // Are any counters open?
+    bool    is_open() const;
+
+    // Zeroes the counters and starts counting
+    void    start();
+
+    // Stops counting
+    void    stop();
+
+    // Fetches the counts accumulated between start() and stop()
+    perf_counts_t read() const;
+
+    // Closes the counters
+    void    close();
+
+    // Returns the short name of a counter, e.g. "llc_misses"
+    static const char* name(perf_counter_t counter);
+
+protected:
+
+    // One file descriptor per counter, or -1 if it isn't available
+    int     fd_[PERF_COUNTER_COUNT];
+};
+//=============================================================================
+
+
+//=============================================================================
+// perf_summary() - Formats counts as per-packet costs, for example:
+//
+//     "cycles/pkt=41.2 instr/pkt=97.0 ipc=2.35 llc_misses/pkt=0.01 ..."
+//
+// Counters that weren't measured are left out.  Returns "" if none were.
+//=============================================================================
+std::string perf_summary(const perf_counts_t& counts, uint64_t packets);
+//=============================================================================
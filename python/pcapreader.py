@@ -0,0 +1,218 @@
+#==============================================================================
+# pcapreader.py - Python access to libpcapreader.so
+#
+# The packets are read and their headers are parsed in C++.  Each batch's
+# parsed headers come back as columns that are memoryviews of the C++
+# memory.  They can be indexed as they are (batch.udp_dst_port[0] is an
+# int), and wrapping them with NumPy costs no copying:
+#
+#     import numpy as np
+#     import pcapreader
+#
+#     with pcapreader.Reader("ch0_packets.pcap") as reader:
+#         for batch in reader:
+#             ports = np.frombuffer(batch.udp_dst_port, dtype=np.uint16)
+#             first = batch.packet(0)          # memoryview of packet data
+#
+# A batch's columns and packet data are only valid until the next batch is
+# read.  Copy anything that needs to live longer (np.array(column) does).
+# Closing the reader doesn't pull the memory out from under them, though:
+# the C++ reader is only freed once nothing that aliases it is left.
+#
+# The library is found via $PCAPREADER_LIB, or next to this directory, or 
+# on the usual library path.
+#==============================================================================
+import ctypes
+import ctypes.util
+import os
+
+#------------------------------------------------------------------------------
+# Status codes returned by the library (pcapr_status_t)
+#------------------------------------------------------------------------------
+OK, EOF, TRUNCATED, BAD_LENGTH, NOT_OPEN, IO_ERROR, OUT_OF_MEMORY = range(7)
+
+#------------------------------------------------------------------------------
+# The columns of pcapr_columns_t, in order, with their element types
+#------------------------------------------------------------------------------
+_COLUMNS = [
+    ("layers",          ctypes.c_uint8),
+    ("ts_seconds",      ctypes.c_uint32),
+    ("ts_nanoseconds",  ctypes.c_uint32),
+    ("length",          ctypes.c_uint32),
+    ("data_offset",     ctypes.c_uint32),
+    ("eth_type",        ctypes.c_uint16),
+    ("ip4_protocol",    ctypes.c_uint8),
+    ("ip4_src_ip",      ctypes.c_uint32),
+    ("ip4_dst_ip",      ctypes.c_uint32),
+    ("udp_src_port",    ctypes.c_uint16),
+    ("udp_dst_port",    ctypes.c_uint16),
+    ("udp_length",      ctypes.c_uint16),
+    ("rdmx_target",     ctypes.c_uint64),
+]
+
+
+class _Columns(ctypes.Structure):
+    _fields_ = [
+        ("count",     ctypes.c_size_t),
+        ("data_base", ctypes.c_void_p),
+        ("data_span", ctypes.c_size_t),
+    ] + [(name, ctypes.POINTER(ctype)) for name, ctype in _COLUMNS]
+
+
+#==============================================================================
+# _load() - Finds and loads the shared library, and declares its functions
+#==============================================================================
+def _load():
+    candidates = [
+        os.environ.get("PCAPREADER_LIB"),
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "libpcapreader.so"),
+        ctypes.util.find_library("pcapreader"),
+    ]
+    path = next((c for c in candidates if c and os.path.exists(c)), candidates[-1])
+    if path is None:
+        raise OSError("Can't find libpcapreader.so; set PCAPREADER_LIB")
+
+    lib = ctypes.CDLL(path)
+
+    lib.pcapr_open.restype  = ctypes.c_void_p
+    lib.pcapr_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+
+    lib.pcapr_close.restype  = None
+    lib.pcapr_close.argtypes = [ctypes.c_void_p]
+
+    lib.pcapr_next_columns.restype  = ctypes.c_int
+    lib.pcapr_next_columns.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(_Columns)]
+
+    lib.pcapr_skip_bad_record.restype  = ctypes.c_int
+    lib.pcapr_skip_bad_record.argtypes = [ctypes.c_void_p]
+
+    lib.pcapr_status_string.restype  = ctypes.c_char_p
+    lib.pcapr_status_string.argtypes = [ctypes.c_int]
+    return lib
+
+_lib = _load()
+
+
+#==============================================================================
+# _Handle - Owns the C++ reader, and frees it when the last reference to it
+#           goes away.  The Reader holds one, and so does every array that
+#           aliases the reader's memory, so closing the Reader while batches
+#           (or NumPy views of them) are still around doesn't free anything
+#           they point at.
+#==============================================================================
+class _Handle:
+
+    def __init__(self, value):
+        self.value = value
+
+    def __del__(self):
+        # _lib may already be gone if this runs at interpreter shutdown
+        if self.value and _lib:
+            _lib.pcapr_close(self.value)
+        self.value = None
+
+
+#==============================================================================
+# _alias() - Returns an array of type 'array_type' at 'address' in the C++
+#            reader's memory.  The array holds on to 'handle', so the reader
+#            outlives it, and anything made from it (a memoryview, or a
+#            NumPy array) holds on to the array.
+#==============================================================================
+def _alias(handle, array_type, address):
+    array = array_type.from_address(address)
+    array._handle = handle
+    return array
+
+
+#==============================================================================
+# Batch - The parsed headers of a batch of packets.  Every column named in 
+#         _COLUMNS is an attribute holding a memoryview that aliases the
+#         C++ column.
+#==============================================================================
+class Batch:
+
+    def __init__(self, handle, columns):
+        self.count = columns.count
+        for name, ctype in _COLUMNS:
+            address = ctypes.cast(getattr(columns, name), ctypes.c_void_p).value
+            array = _alias(handle, ctype * self.count, address)
+
+            # ctypes exports its arrays with explicit-endian formats ("<H"),
+            # which memoryview can't index, so recast them to the native
+            # format code
+            setattr(self, name, memoryview(array).cast("B").cast(ctype._type_))
+
+        # All of the packet data, as one buffer
+        data = _alias(handle, ctypes.c_uint8 * columns.data_span, columns.data_base)
+        self.data = memoryview(data)
+
+    def __len__(self):
+        return self.count
+
+    def packet(self, i):
+        """Returns a memoryview of the data of packet 'i'"""
+        offset = self.data_offset[i]
+        return self.data[offset : offset + self.length[i]]
+
+    def numpy(self):
+        """Returns a dict of NumPy arrays that alias the columns"""
+        import numpy as np
+        return {name: np.frombuffer(getattr(self, name), dtype=np.dtype(ctype))
+                for name, ctype in _COLUMNS}
+
+
+#==============================================================================
+# Reader - Reads a PCAP file a batch at a time
+#==============================================================================
+class Reader:
+
+    def __init__(self, filename, batch_size=4096, skip_bad=False):
+        """Opens a PCAP file.  With skip_bad, corrupt packets are skipped 
+           rather than raising an exception"""
+        error = ctypes.create_string_buffer(1024)
+        self._handle = None
+        handle = _lib.pcapr_open(os.fsencode(filename), error, len(error))
+        if not handle:
+            raise OSError(error.value.decode())
+        self._handle = _Handle(handle)
+        self._batch_size = batch_size
+        self._skip_bad = skip_bad
+
+    def close(self):
+        """Closes the reader.  The C++ reader is freed straight away unless
+           a batch from it is still referenced, in which case it's freed
+           once the last one goes"""
+        self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def next_batch(self):
+        """Returns the next Batch, or None when there are no more packets"""
+        if not self._handle:
+            raise ValueError("Reader is closed")
+        columns = _Columns()
+        while True:
+            status = _lib.pcapr_next_columns(self._handle.value, self._batch_size, ctypes.byref(columns))
+            if status == OK:
+                return Batch(self._handle, columns)
+            if status == BAD_LENGTH and self._skip_bad:
+                if _lib.pcapr_skip_bad_record(self._handle.value) == OK:
+                    continue
+                return None
+            if status in (EOF, TRUNCATED):
+                return None
+            raise IOError(_lib.pcapr_status_string(status).decode())
+
+    def __iter__(self):
+        while True:
+            batch = self.next_batch()
+            if batch is None:
+                return
+            yield batch
@@ -0,0 +1,108 @@
+//=============================================================================
+// stage_latency.cpp - Per-stage latency histograms
+//=============================================================================
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "stage_latency.h"
+
+using namespace std;
+
+
+//=============================================================================
+// clear() - Empties the histogram
+//=============================================================================
+void CLatencyHistogram::clear()
+{
+    memset(bucket_, 0, sizeof(bucket_));
+    count_ = sum_ = max_ = 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// percentile() - Returns the duration that "fraction" of the samples were
+//                at or under
+//=============================================================================
+uint64_t CLatencyHistogram::percentile(double fraction) const
+{
+    if (count_ == 0) return 0;
+
+    uint64_t wanted = (uint64_t)(fraction * count_), seen = 0;
+    if (wanted == 0) wanted = 1;
+
+    for (int i=0; i<64; ++i)
+    {
+        seen += bucket_[i];
+        if (seen >= wanted)
+        {
+            uint64_t top = (i == 63) ? UINT64_MAX : (2ull << i) - 1;
+            return (top < max_) ? top : max_;
+        }
+    }
+
+    return max_;
+}
+//=============================================================================
+
+
+//=============================================================================
+// tsc_ticks_per_ns() - Measures the TSC rate against the steady clock
+//=============================================================================
+double tsc_ticks_per_ns()
+{
+    static double rate = 0;
+    if (rate) return rate;
+
+    auto     start_time = chrono::steady_clock::now();
+    uint64_t start_tsc  = read_tsc();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    uint64_t end_tsc    = read_tsc();
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start_time;
+
+    rate = (end_tsc - start_tsc) / elapsed.count();
+    return rate;
+}
+//=============================================================================
+
+
+#ifdef PCAPREADER_LATENCY
+
+//=============================================================================
+// clear() - Empties every histogram
+//=============================================================================
+void CStageLatency::clear()
+{
+    for (auto& histogram : histogram_) histogram.clear();
+    total_.clear();
+}
+//=============================================================================
+
+
+//=============================================================================
+// report() - Prints a table of latencies in nanoseconds
+//=============================================================================
+void CStageLatency::report(FILE* file) const
+{
+    static const char* names[STAGE_COUNT] = {"read", "parse", "filter", "enqueue", "consume"};
+    double rate = tsc_ticks_per_ns();
+
+    fprintf(file, "%-8s %12s %10s %10s %10s %10s %10s\n", "stage", "count", "mean_ns", "p50_ns", "p99_ns", "p999_ns", "max_ns");
+
+    for (int i=0; i<=STAGE_COUNT; ++i)
+    {
+        const CLatencyHistogram& h = (i < STAGE_COUNT) ? histogram_[i] : total_;
+        if (h.count() == 0) continue;
+
+        fprintf(file, "%-8s %12lu %10.1f %10.0f %10.0f %10.0f %10.0f\n",
+            (i < STAGE_COUNT) ? names[i] : "total", h.count(),
+            h.sum() / rate / h.count(),
+            h.percentile(0.50)  / rate,
+            h.percentile(0.99)  / rate,
+            h.percentile(0.999) / rate,
+            h.max() / rate);
+    }
+}
+//=============================================================================
+
+#endif
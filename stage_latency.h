@@ -0,0 +1,177 @@
+//=============================================================================
+// stage_latency.h - Per-stage latency histograms, timed with the TSC
+//
+// A packet's journey is divided into stages: read, parse, filter, enqueue 
+// and consume.  The thread handling a packet calls start() when the record
+// becomes available and mark() at the end of each stage, and the time 
+// since the previous mark is added to that stage's histogram.  The time 
+// from start() to the "consume" mark is also recorded, as the end-to-end
+// latency.
+//
+// for_each_packet() marks the read, parse and consume stages itself when
+// it's given a CStageLatency.  A callback that filters or enqueues packets
+// marks those stages from inside the callback.  When a packet crosses to
+// another thread, pass stamp() along with it, and have the consuming 
+// thread's own CStageLatency resume() from it.
+//
+// All of this is compiled in only when PCAPREADER_LATENCY is defined 
+// ("make LATENCY=1").  Otherwise every method is an empty inline function,
+// and the instrumentation compiles to nothing.
+//=============================================================================
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+
+//=============================================================================
+// The stages of a packet's journey
+//=============================================================================
+enum class stage_t : uint8_t {read, parse, filter, enqueue, consume};
+const int STAGE_COUNT = 5;
+//=============================================================================
+
+
+//=============================================================================
+// read_tsc() - Returns the CPU's timestamp counter
+//=============================================================================
+inline uint64_t read_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+//=============================================================================
+
+
+//=============================================================================
+// A histogram of durations in TSC ticks, with one bucket per power of two.
+// It has a single writer, and should be read once the writer is finished.
+//=============================================================================
+class CLatencyHistogram
+{
+public:
+
+    CLatencyHistogram() {clear();}
+
+    void    clear();
+
+    // Adds a duration
+    void    add(uint64_t ticks)
+    {
+        ++bucket_[ticks ? 63 - __builtin_clzll(ticks) : 0];
+        ++count_;
+        sum_ += ticks;
+        if (ticks > max_) max_ = ticks;
+    }
+
+    // Returns the duration, in ticks, that "fraction" of the samples were 
+    // at or under.  This is the top of a bucket, so it errs on the high side
+    // by up to a factor of two.
+    uint64_t percentile(double fraction) const;
+
+    uint64_t count() const {return count_;}
+    uint64_t sum()   const {return sum_;}
+    uint64_t max()   const {return max_;}
+
+protected:
+
+    uint64_t bucket_[64];
+    uint64_t count_, sum_, max_;
+};
+//=============================================================================
+
+
+#ifdef PCAPREADER_LATENCY
+
+class CStageLatency
+{
+public:
+
+    static const bool enabled = true;
+
+    // A record has become available
+    void    start() {start_ = last_ = read_tsc();}
+
+    // A stage has finished
+    void    mark(stage_t stage)
+    {
+        uint64_t now = read_tsc();
+        histogram_[(int)stage].add(now - last_);
+        if (stage == stage_t::consume) total_.add(now - start_);
+        last_ = now;
+    }
+
+    // Hands the timing of a packet from one thread to another
+    uint64_t stamp() const {return start_;}
+    void    resume(uint64_t stamp) {start_ = last_ = stamp;}
+
+    // The histograms
+    const CLatencyHistogram& histogram(stage_t stage) const {return histogram_[(int)stage];}
+    const CLatencyHistogram& total() const {return total_;}
+
+    // Clears the histograms
+    void    clear();
+
+    // Prints a table of the count, mean and percentiles of every stage, 
+    // in nanoseconds
+    void    report(FILE* file) const;
+
+protected:
+
+    CLatencyHistogram histogram_[STAGE_COUNT], total_;
+    uint64_t start_ = 0, last_ = 0;
+};
+
+#else
+
+class CStageLatency
+{
+public:
+
+    static const bool enabled = false;
+
+    void    start() {}
+    void    mark(stage_t) {}
+    uint64_t stamp() const {return 0;}
+    void    resume(uint64_t) {}
+    void    clear() {}
+    void    report(FILE*) const {}
+};
+
+#endif
+//=============================================================================
+
+
+//=============================================================================
+// These are for code that has an optional CStageLatency.  Without 
+// PCAPREADER_LATENCY they compile to nothing, null check included.
+//=============================================================================
+inline void latency_start(CStageLatency* latency)
+{
+#ifdef PCAPREADER_LATENCY
+    if (latency) latency->start();
+#endif
+}
+
+inline void latency_mark(CStageLatency* latency, stage_t stage)
+{
+#ifdef PCAPREADER_LATENCY
+    if (latency) latency->mark(stage);
+#endif
+}
+//=============================================================================
+
+
+//=============================================================================
+// tsc_ticks_per_ns() - Measures how fast the TSC runs.  The first call takes
+//                      about 20 milliseconds.
+//=============================================================================
+double tsc_ticks_per_ns();
+//=============================================================================
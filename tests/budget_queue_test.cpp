@@ -0,0 +1,120 @@
+//=============================================================================
+// budget_queue_test.cpp - Checks that CBudgetQueue and the memory budget
+//                         behind it let go of producers when they should.
+//
+// Each check prints a line saying whether it passed.  A push() that never
+// returns can't be joined, so a check that hangs is reported as a failure
+// after a few seconds, and the program exits without waiting for it.
+//
+// The exit status is 1 if any check failed.
+//=============================================================================
+#include <unistd.h>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <future>
+#include <thread>
+#include "memory_budget.h"
+#include "budget_queue.h"
+
+using namespace std;
+
+// How long a push() that should be released is given to return
+static const chrono::seconds HANG_TIMEOUT(5);
+
+static int failures = 0;
+
+
+//=============================================================================
+// check() - Reports the result of a check
+//=============================================================================
+static void check(const char* what, bool passed)
+{
+    printf("  %-60s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed) ++failures;
+}
+//=============================================================================
+
+
+//=============================================================================
+// push_while_full() - Fills the budget, then starts a push() that has to
+//                     wait for it.  Returns the future of that push().
+//=============================================================================
+static future<bool> push_while_full(CBudgetQueue<int>& queue)
+{
+    queue.push(1);
+    queue.push(2);
+    return async(launch::async, [&]{return queue.push(3);});
+}
+//=============================================================================
+
+
+//=============================================================================
+// check_close_while_blocked() - close() must release a push() that's
+//                               waiting for the budget
+//=============================================================================
+static void check_close_while_blocked()
+{
+    CMemoryBudget budget(2 * sizeof(int));
+    CBudgetQueue<int> queue(budget);
+
+    auto pushed = push_while_full(queue);
+    bool blocked = pushed.wait_for(chrono::milliseconds(100)) == future_status::timeout;
+    check("push() waits while the budget is full", blocked);
+
+    queue.close();
+    if (pushed.wait_for(HANG_TIMEOUT) != future_status::ready)
+    {
+        check("close() releases a push() waiting for the budget", false);
+        fflush(stdout);
+        _exit(1);
+    }
+    check("close() releases a push() waiting for the budget", true);
+    check("The released push() reports that it dropped its item", !pushed.get());
+    check("The released push() charged nothing to the budget", budget.stats().used == 2 * sizeof(int));
+
+    int item;
+    bool drained = queue.pop(&item) && item == 1 && queue.pop(&item) && item == 2 && !queue.pop(&item);
+    check("The items pushed before close() can still be popped", drained);
+    check("Popping them gives the budget back", budget.stats().used == 0);
+    check("push() after close() is refused", !queue.push(4) && budget.stats().used == 0);
+}
+//=============================================================================
+
+
+//=============================================================================
+// check_pop_while_blocked() - pop() must still make room for a push()
+//                             that's waiting for the budget
+//=============================================================================
+static void check_pop_while_blocked()
+{
+    CMemoryBudget budget(2 * sizeof(int));
+    CBudgetQueue<int> queue(budget);
+
+    auto pushed = push_while_full(queue);
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    int item;
+    queue.pop(&item);
+    bool returned = pushed.wait_for(HANG_TIMEOUT) == future_status::ready;
+    if (!returned)
+    {
+        check("pop() makes room for a push() waiting for the budget", false);
+        fflush(stdout);
+        _exit(1);
+    }
+    check("pop() makes room for a push() waiting for the budget", pushed.get());
+    check("The budget is throttled while push() waits", budget.stats().throttle_events == 1);
+}
+//=============================================================================
+
+
+int main()
+{
+    printf("CBudgetQueue:\n");
+    check_close_while_blocked();
+    check_pop_while_blocked();
+
+    printf("%s\n", failures ? "SOME CHECKS FAILED" : "All checks passed");
+    return failures ? 1 : 0;
+}
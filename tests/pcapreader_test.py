@@ -0,0 +1,129 @@
+#==============================================================================
+# pcapreader_test.py - Checks the Python binding without NumPy.
+#
+# Every batch column is indexed as a plain memoryview, and each value is
+# compared with the same field fetched from the packet's bytes (or, for the
+# timestamps and lengths, from the file's record headers) by Python alone.
+# The 16-, 32- and 64-bit columns are all covered.  The binding is then
+# checked to keep a batch readable after its reader is closed.
+#
+# Usage: python3 tests/pcapreader_test.py [capture]
+#
+# The exit status is 1 if any check failed.
+#==============================================================================
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "python"))
+import pcapreader
+
+failures = 0
+
+# The offsets of the fields in a packet, and their formats
+_FIELDS = [
+    ("eth_type",        12, ">H"),
+    ("ip4_protocol",    23, ">B"),
+    ("ip4_src_ip",      26, ">I"),
+    ("ip4_dst_ip",      30, ">I"),
+    ("udp_src_port",    34, ">H"),
+    ("udp_dst_port",    36, ">H"),
+    ("udp_length",      38, ">H"),
+    ("rdmx_target",     44, ">Q"),
+]
+
+# Packets shorter than this don't hold every field
+_HEADERS_SIZE = 52
+
+
+#==============================================================================
+# check() - Reports the result of a check
+#==============================================================================
+def check(what, passed):
+    global failures
+    print("  %-60s %s" % (what, "ok" if passed else "FAILED"))
+    if not passed:
+        failures += 1
+
+
+#==============================================================================
+# records() - Yields the (seconds, fraction, length) of each record in a
+#             capture, read by Python alone
+#==============================================================================
+def records(filename):
+    with open(filename, "rb") as f:
+        f.read(24)
+        while True:
+            header = f.read(16)
+            if len(header) < 16:
+                return
+            seconds, fraction, length, _ = struct.unpack("<IIII", header)
+            f.seek(length, os.SEEK_CUR)
+            yield seconds, fraction, length
+
+
+#==============================================================================
+# check_columns() - Indexes every column of every batch, and compares it
+#                   with what Python finds in the file
+#==============================================================================
+def check_columns(filename):
+    expected = records(filename)
+    packets = mismatches = 0
+    widths = set()
+
+    with pcapreader.Reader(filename, batch_size=1000) as reader:
+        for batch in reader:
+            for i in range(len(batch)):
+                seconds, fraction, length = next(expected)
+                data = bytes(batch.packet(i))
+                ok = (batch.ts_seconds[i] == seconds and
+                      batch.ts_nanoseconds[i] == fraction and
+                      batch.length[i] == length and len(data) == length)
+
+                if length >= _HEADERS_SIZE:
+                    for name, offset, fmt in _FIELDS:
+                        column = getattr(batch, name)
+                        widths.add(column.itemsize)
+                        ok = ok and column[i] == struct.unpack_from(fmt, data, offset)[0]
+
+                packets += 1
+                mismatches += not ok
+
+    check("%s: %d packets read" % (os.path.basename(filename), packets), packets > 0)
+    check("Every column agrees with the packet bytes", mismatches == 0)
+    check("16-, 32- and 64-bit columns were all indexed", {2, 4, 8} <= widths)
+
+
+#==============================================================================
+# check_close() - A batch must stay readable after its reader is closed
+#==============================================================================
+def check_close(filename):
+    with pcapreader.Reader(filename) as reader:
+        batch = reader.next_batch()
+        port = batch.udp_dst_port[0]
+        packet = bytes(batch.packet(0))
+
+    check("A batch is still readable after its reader is closed",
+          batch.udp_dst_port[0] == port and bytes(batch.packet(0)) == packet)
+
+    try:
+        reader.next_batch()
+        check("next_batch() on a closed reader raises ValueError", False)
+    except ValueError:
+        check("next_batch() on a closed reader raises ValueError", True)
+
+
+def main():
+    here = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+    filename = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "ch0_packets.pcap")
+
+    print("pcapreader.py:")
+    check_columns(filename)
+    check_close(filename)
+
+    print("SOME CHECKS FAILED" if failures else "All checks passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,557 @@
+//=============================================================================
+// bench.cpp - Measures the throughput of every way of reading and parsing
+//             a PCAP file, over captures with several packet-size mixes.
+//
+// Results are written one JSON object per line, to stdout and optionally
+// to a file:
+//
+//   {"suite":"read","case":"view","dist":"imix","packets":..., "bytes":...,
+//    "seconds":..., "seconds_min":..., "pps":..., "gbps":...}
+//
+// "seconds" is the median over the repetitions and "seconds_min" the 
+// fastest.  The rates are computed from the median.
+//
+// Where the hardware performance counters are available, each line also
+// has the per-packet cost of each counter, averaged over the repetitions:
+// "cycles_per_packet", "instructions_per_packet", "llc_misses_per_packet",
+// "dtlb_misses_per_packet", "branch_misses_per_packet" and "ipc".
+//
+// Built with "make LATENCY=1", there's also a "for_each_latency" case, and 
+// a table of its per-stage latencies is printed to stderr.
+//
+// With "-compare <file>", the results are compared with a baseline written
+// earlier by "-out".  Each case is flagged as a regression if its packets 
+// per second fell, or its cycles per packet rose, by more than a threshold.
+// The threshold is the "-tolerance" percentage (default 5) plus twice the 
+// noise seen in the two runs, where a run's noise is how far its median 
+// time was from its fastest.  pcapbench exits with status 1 if there were 
+// any regressions.
+//
+// Usage: pcapbench [-size <MB>] [-reps <n>] [-dist <name,...>] 
+//                  [-dir <path>] [-out <file>] [-compare <baseline>]
+//                  [-tolerance <percent>]
+//=============================================================================
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <functional>
+#include <stdexcept>
+#include "pcap_reader.h"
+#include "pcap_set_reader.h"
+#include "packet_parse.h"
+#include "for_each_packet.h"
+#include "header_columns.h"
+#include "cpu_dispatch.h"
+#include "pcap_generator.h"
+#include "perf_counters.h"
+
+using namespace std;
+
+// Command line options
+static size_t           size_mb  = 64;
+static int              reps     = 5;
+static string           dir      = "/tmp";
+static string           out_name;
+static string           baseline_name;
+static double           tolerance = 5.0;
+static vector<string>   dists    = {"64", "512", "1500", "imix", "uniform"};
+
+// The file we write results to, if any
+static FILE*            out_file = nullptr;
+
+// Every result line written so far
+static vector<string>   results;
+
+// Hardware counters, if the kernel lets us have them
+static CPerfCounters    perf;
+
+// Summed from packet data so the compiler can't discard the work
+static volatile uint64_t sink;
+
+
+//=============================================================================
+// write_capture() - Writes a capture of roughly "bytes" bytes, made of 
+//                   Ethernet/IPv4/UDP/RDMX packets whose sizes follow "dist"
+//=============================================================================
+static void write_capture(const string& filename, const string& dist, size_t bytes)
+{
+    pcap_generator_config_t config;
+    config.total_bytes = bytes;
+    config.size_mix    = dist;
+    config.timestamps  = "jitter:550";
+    CPcapGenerator(config).write(filename);
+}
+//=============================================================================
+
+
+//=============================================================================
+// report() - Times "body" over the repetitions and writes a result line.  
+//            "body" returns the number of packets and bytes it processed.
+//=============================================================================
+static void report(const char* suite, const string& name, const string& dist,
+                   function<void(uint64_t&, uint64_t&)> body)
+{
+    vector<double> seconds;
+    uint64_t packets = 0, bytes = 0, total_packets = 0;
+    perf_counts_t counts;
+
+    for (int i=0; i<reps; ++i)
+    {
+        packets = bytes = 0;
+        perf.start();
+        auto start = chrono::steady_clock::now();
+        body(packets, bytes);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        perf.stop();
+        seconds.push_back(elapsed.count());
+        counts += perf.read();
+        total_packets += packets;
+    }
+
+    sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+
+    char line[1024];
+    int length = snprintf(line, sizeof(line),
+        "{\"suite\":\"%s\",\"case\":\"%s\",\"dist\":\"%s\",\"packets\":%lu,\"bytes\":%lu,"
+        "\"seconds\":%.6f,\"seconds_min\":%.6f,\"pps\":%.0f,\"gbps\":%.3f,\"isa\":\"%s\"",
+        suite, name.c_str(), dist.c_str(), packets, bytes, median, seconds[0],
+        packets / median, bytes / median / 1e9, cpu_dispatch_level());
+
+    // Add the per-packet cost of each hardware counter we could measure
+    if (total_packets == 0) total_packets = 1;
+    for (int i=0; i<PERF_COUNTER_COUNT; ++i) if (counts.has((perf_counter_t)i))
+    {
+        length += snprintf(line + length, sizeof(line) - length, ",\"%s_per_packet\":%.3f", 
+            CPerfCounters::name((perf_counter_t)i), (double)counts.value[i] / total_packets);
+    }
+    if (counts.has(PERF_CYCLES) && counts.has(PERF_INSTRUCTIONS) && counts.value[PERF_CYCLES])
+    {
+        length += snprintf(line + length, sizeof(line) - length, ",\"ipc\":%.3f", 
+            (double)counts.value[PERF_INSTRUCTIONS] / counts.value[PERF_CYCLES]);
+    }
+
+    snprintf(line + length, sizeof(line) - length, "}\n");
+
+    fputs(line, stdout);
+    fflush(stdout);
+    if (out_file) fputs(line, out_file);
+    results.push_back(line);
+}
+//=============================================================================
+
+
+//=============================================================================
+// bench_read() - Measures every way of reading a file
+//=============================================================================
+static void bench_read(const string& filename, const string& dist)
+{
+    report("read", "fread", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        static pcap_packet_t packet;
+        reader.open(filename);
+        while (reader.get_next_packet(&packet)) {++packets; bytes += packet.length; sink += packet.data[0];}
+    });
+
+    report("read", "view", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        reader.open(filename);
+        for (auto& packet : reader) {++packets; bytes += packet.length; sink += packet.data[0];}
+    });
+
+    report("read", "batch", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        CPacketBatch batch;
+        reader.open(filename);
+        while (reader.get_next_batch(batch))
+        {
+            for (auto& packet : batch) {++packets; bytes += packet.length; sink += packet.data[0];}
+        }
+    });
+
+    report("read", "for_each", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        reader.open(filename);
+        packets = for_each_packet(reader, [&](const packet_view_t& packet) 
+        {
+            bytes += packet.length; 
+            sink += packet.data[0];
+        });
+    });
+
+    // In a latency build, time each stage of the for_each loop too
+    if (CStageLatency::enabled)
+    {
+        CStageLatency latency;
+        report("read", "for_each_latency", dist, [&](uint64_t& packets, uint64_t& bytes)
+        {
+            CPcapReader reader;
+            reader.open(filename);
+            packets = for_each_packet<parse_depth_t::udp>(reader, [&](const packet_view_t& packet, const eth_header_t& header)
+            {
+                bytes += packet.length; 
+                sink += header.udp_dst_port;
+            }, &latency);
+        });
+        latency.report(stderr);
+    }
+
+    report("read", "shared", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CBlockPool pool;
+        CPcapReader reader;
+        shared_packet_t packet;
+        reader.set_block_pool(&pool);
+        reader.open(filename);
+        while (reader.get_next_shared(&packet)) {++packets; bytes += packet.view.length; sink += packet.view.data[0];}
+        packet.block.reset();
+    });
+
+    report("read", "set", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapSetReader reader;
+        static pcap_packet_t packet;
+        reader.open(filename + "*");
+        while (reader.get_next_packet(&packet)) {++packets; bytes += packet.length; sink += packet.data[0];}
+    });
+}
+//=============================================================================
+
+
+//=============================================================================
+// load_views() - Loads a whole file into memory, and makes a view of each
+//                packet in it
+//=============================================================================
+static void load_views(const string& filename, vector<uint8_t>& image, vector<packet_view_t>& views)
+{
+    FILE* ifile = fopen(filename.c_str(), "r");
+    if (ifile == nullptr) throw runtime_error("Can't open " + filename);
+    fseek(ifile, 0, SEEK_END);
+    size_t file_size = ftell(ifile);
+    fseek(ifile, 0, SEEK_SET);
+
+    // The slack at the end keeps header parsing of a runt packet in bounds
+    image.assign(file_size + 64, 0);
+    if (fread(image.data(), 1, file_size, ifile) != file_size) throw runtime_error("Can't read " + filename);
+    fclose(ifile);
+
+    views.clear();
+    for (size_t offset = sizeof(pcap_header_t); offset + 16 <= file_size; )
+    {
+        packet_view_t view;
+        memcpy(&view, image.data() + offset, 12);
+        view.data = image.data() + offset + 16;
+        views.push_back(view);
+        offset += 16 + view.length;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// bench_parse() - Measures every way of parsing headers.  The packets are 
+//                 all in memory first, so that only the parsing is timed.
+//=============================================================================
+static void bench_parse(const string& filename, const string& dist)
+{
+    vector<uint8_t> image;
+    vector<packet_view_t> views;
+    load_views(filename, image, views);
+
+    report("parse", "parse_packet_headers", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        eth_header_t header;
+        for (auto& packet : views)
+        {
+            reader.parse_packet_headers(packet.data, &header);
+            sink += header.is_rdmx + header.udp_dst_port;
+            bytes += packet.length;
+        }
+        packets = views.size();
+    });
+
+    report("parse", "parse_headers", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        eth_header_t header;
+        for (auto& packet : views)
+        {
+            parse_headers<parse_depth_t::rdmx>(packet.data, &header);
+            sink += header.is_rdmx + header.udp_dst_port;
+            bytes += packet.length;
+        }
+        packets = views.size();
+    });
+
+    report("parse", "parse_headers_udp", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        eth_header_t header;
+        for (auto& packet : views)
+        {
+            parse_headers<parse_depth_t::udp>(packet.data, &header);
+            sink += header.is_udp + header.udp_dst_port;
+            bytes += packet.length;
+        }
+        packets = views.size();
+    });
+
+    // The batch decoders work on batches of views taken from the array
+    CPacketBatch batch;
+    auto for_each_batch = [&](function<void(const CPacketBatch&)> body)
+    {
+        for (size_t first = 0; first < views.size(); first += batch.capacity())
+        {
+            size_t count = min(batch.capacity(), views.size() - first);
+            memcpy(batch.views(), &views[first], count * sizeof(packet_view_t));
+            batch.set_size(count);
+            body(batch);
+        }
+    };
+
+    report("parse", "decode_headers", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        vector<eth_header_compact_t> headers(batch.capacity());
+        for_each_batch([&](const CPacketBatch& batch)
+        {
+            decode_headers(batch, headers.data());
+            for (size_t i=0; i<batch.size(); ++i) {sink += headers[i].layers; bytes += batch[i].length;}
+        });
+        packets = views.size();
+    });
+
+    report("parse", "columns", dist, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CHeaderColumns columns;
+        for_each_batch([&](const CPacketBatch& batch)
+        {
+            columns.decode(batch);
+            for (size_t i=0; i<columns.size(); ++i) {sink += columns.layers[i]; bytes += columns.length[i];}
+        });
+        packets = views.size();
+    });
+}
+//=============================================================================
+
+
+//=============================================================================
+// json_field() - Fetches the value of "key" from a result line, or "" if 
+//                the line doesn't have one.  Result lines are flat objects,
+//                so there's no need for a real JSON parser.
+//=============================================================================
+static string json_field(const string& line, const string& key)
+{
+    string tag = "\"" + key + "\":";
+    size_t pos = line.find(tag);
+    if (pos == string::npos) return "";
+    pos += tag.size();
+
+    if (line[pos] == '"')
+    {
+        size_t end = line.find('"', pos + 1);
+        return line.substr(pos + 1, end - pos - 1);
+    }
+
+    size_t end = line.find_first_of(",}", pos);
+    return line.substr(pos, end - pos);
+}
+//=============================================================================
+
+
+//=============================================================================
+// result_key() - Returns the name that identifies a result line's case
+//=============================================================================
+static string result_key(const string& line)
+{
+    return json_field(line, "suite") + "/" + json_field(line, "case") + "/" 
+         + json_field(line, "dist");
+}
+//=============================================================================
+
+
+//=============================================================================
+// noise() - Returns how noisy the repetitions of a result were, as the
+//           fraction by which the median time exceeded the fastest
+//=============================================================================
+static double noise(const string& line)
+{
+    double median  = atof(json_field(line, "seconds").c_str());
+    double fastest = atof(json_field(line, "seconds_min").c_str());
+    return (median > 0) ? (median - fastest) / median : 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// compare_with_baseline() - Compares this run's results with those in the
+//                           baseline file.  Returns the number of cases 
+//                           that regressed.
+//=============================================================================
+static int compare_with_baseline(const string& filename)
+{
+    ifstream file(filename);
+    if (!file) throw runtime_error("Can't open " + filename);
+
+    map<string, string> baseline;
+    string line;
+    while (getline(file, line))
+    {
+        if (!line.empty()) baseline[result_key(line)] = line;
+    }
+
+    fprintf(stderr, "\nCompared with %s (tolerance %.1f%% + noise)\n\n", filename.c_str(), tolerance);
+    fprintf(stderr, "  %-32s %9s %9s %9s  %s\n", "case", "pps", "cycles", "threshold", "verdict");
+
+    int regressions = 0;
+    for (const string& current : results)
+    {
+        string key = result_key(current);
+        auto it = baseline.find(key);
+        if (it == baseline.end())
+        {
+            fprintf(stderr, "  %-32s %9s %9s %9s  not in baseline\n", key.c_str(), "", "", "");
+            continue;
+        }
+        const string& before = it->second;
+
+        if (json_field(before, "isa") != json_field(current, "isa"))
+        {
+            fprintf(stderr, "  %-32s baseline was run with \"%s\" kernels, this run with \"%s\"\n",
+                key.c_str(), json_field(before, "isa").c_str(), json_field(current, "isa").c_str());
+        }
+
+        // How much the rate fell, as a fraction (positive is worse)
+        double pps_before = atof(json_field(before, "pps").c_str());
+        double pps_now    = atof(json_field(current, "pps").c_str());
+        double pps_loss   = (pps_before > 0) ? 1 - pps_now / pps_before : 0;
+
+        // How much the cycles per packet rose, if both runs counted them
+        string cycles_before = json_field(before, "cycles_per_packet");
+        string cycles_now    = json_field(current, "cycles_per_packet");
+        bool   has_cycles    = !cycles_before.empty() && !cycles_now.empty() && atof(cycles_before.c_str()) > 0;
+        double cycles_gain   = has_cycles ? atof(cycles_now.c_str()) / atof(cycles_before.c_str()) - 1 : 0;
+
+        double threshold = tolerance / 100 + 2 * (noise(before) + noise(current));
+
+        const char* verdict = "ok";
+        if (pps_loss > threshold || cycles_gain > threshold)
+        {
+            verdict = "REGRESSION";
+            ++regressions;
+        }
+        else if (pps_loss < -threshold) verdict = "faster";
+
+        char cycles_text[32] = "-";
+        if (has_cycles) snprintf(cycles_text, sizeof(cycles_text), "%+.1f%%", 100 * cycles_gain);
+
+        fprintf(stderr, "  %-32s %+8.1f%% %9s %8.1f%%  %s\n", key.c_str(), 
+            -100 * pps_loss, cycles_text, 100 * threshold, verdict);
+    }
+
+    fprintf(stderr, "\n%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    return regressions;
+}
+//=============================================================================
+
+
+//=============================================================================
+// split() - Splits a comma-separated list
+//=============================================================================
+static vector<string> split(const string& list)
+{
+    vector<string> result;
+    size_t start = 0, comma;
+    while ((comma = list.find(',', start)) != string::npos)
+    {
+        result.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    result.push_back(list.substr(start));
+    return result;
+}
+//=============================================================================
+
+
+//=============================================================================
+// parse_command_line() - Fetches the options from the command line
+//=============================================================================
+static void parse_command_line(int argc, char** argv)
+{
+    for (int i=1; i<argc; ++i)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc) throw runtime_error("Missing value for " + option);
+        string value = argv[++i];
+
+        if      (option == "-size") size_mb  = atoi(value.c_str());
+        else if (option == "-reps") reps     = max(1, atoi(value.c_str()));
+        else if (option == "-dist") dists    = split(value);
+        else if (option == "-dir" ) dir      = value;
+        else if (option == "-out" ) out_name = value;
+        else if (option == "-compare"  ) baseline_name = value;
+        else if (option == "-tolerance") tolerance     = atof(value.c_str());
+        else throw runtime_error("Unknown option " + option);
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// execute() - Runs every benchmark over every size distribution
+//=============================================================================
+static void execute(int argc, char** argv)
+{
+    parse_command_line(argc, argv);
+
+    if (!perf.open()) fprintf(stderr, "Hardware performance counters are unavailable\n");
+
+    if (!out_name.empty())
+    {
+        out_file = fopen(out_name.c_str(), "w");
+        if (out_file == nullptr) throw runtime_error("Can't create " + out_name);
+    }
+
+    for (const string& dist : dists)
+    {
+        string filename = dir + "/pcapbench_" + dist + "_" + to_string(getpid()) + ".pcap";
+        write_capture(filename, dist, size_mb << 20);
+
+        bench_read(filename, dist);
+        bench_parse(filename, dist);
+
+        remove(filename.c_str());
+    }
+
+    if (out_file) fclose(out_file);
+
+    if (!baseline_name.empty() && compare_with_baseline(baseline_name) > 0)
+    {
+        throw runtime_error("Performance regressed against " + baseline_name);
+    }
+}
+//=============================================================================
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        execute(argc, argv);
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
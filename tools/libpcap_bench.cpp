@@ -0,0 +1,363 @@
+//=============================================================================
+// libpcap_bench.cpp - Measures this reader against libpcap, over identical
+//                     captures of several sizes, with the page cache both
+//                     warm and cold.
+//
+// Results are written one JSON object per line, in the same form as
+// pcapbench, to stdout and optionally to a file:
+//
+//   {"suite":"libpcap","case":"pcap_next_ex","cache":"cold","size_mb":256,
+//    "packets":..., "bytes":..., "seconds":..., "seconds_min":...,
+//    "pps":..., "gbps":..., "cycles_per_packet":...}
+//
+// "seconds" is the median over the repetitions and "seconds_min" the
+// fastest.  "cycles_per_packet" is there only when the hardware counters
+// are available.
+//
+// For a "warm" run the file is read once beforehand so that it's in the
+// page cache.  For a "cold" run, the file's pages are dropped from the
+// cache with POSIX_FADV_DONTNEED before each repetition.
+//
+// This needs libpcap, so it isn't built by "make all".  Use
+// "make libpcap-bench".
+//
+// Usage: libpcapbench [-sizes <MB,...>] [-reps <n>] [-dist <name>]
+//                     [-dir <path>] [-out <file>]
+//=============================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <pcap.h>
+#include "pcap_reader.h"
+#include "for_each_packet.h"
+#include "pcap_generator.h"
+#include "perf_counters.h"
+
+using namespace std;
+
+// Command line options
+static vector<string>   sizes    = {"16", "256", "1024"};
+static int              reps     = 5;
+static string           dist     = "imix";
+static string           dir      = "/tmp";
+static string           out_name;
+
+// The file we write results to, if any
+static FILE*            out_file = nullptr;
+
+// Hardware counters, if the kernel lets us have them
+static CPerfCounters    perf;
+
+// Summed from packet data so the compiler can't discard the work
+static volatile uint64_t sink;
+
+// The packet and byte counts that the libpcap callbacks add to
+struct totals_t
+{
+    uint64_t packets;
+    uint64_t bytes;
+};
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// warm_cache() - Reads the whole file so that it's in the page cache
+//=============================================================================
+static void warm_cache(const string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open %s", filename.c_str());
+
+    static char buffer[1 << 20];
+    while (::read(fd, buffer, sizeof(buffer)) > 0) sink += buffer[0];
+    ::close(fd);
+}
+//=============================================================================
+
+
+//=============================================================================
+// drop_cache() - Evicts the file from the page cache.  Dirty pages can't be
+//                dropped, so the file is synced first.
+//=============================================================================
+static void drop_cache(const string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open %s", filename.c_str());
+
+    fdatasync(fd);
+    int rc = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+
+    if (rc != 0) throwRuntime("posix_fadvise failed on %s: %s", filename.c_str(), strerror(rc));
+}
+//=============================================================================
+
+
+//=============================================================================
+// report() - Times "body" over the repetitions and writes a result line.
+//            The cache is put into the requested state before each
+//            repetition, outside the timed region.
+//=============================================================================
+static void report(const char* suite, const char* name, const string& filename,
+                   const string& size, bool cold, function<void(uint64_t&, uint64_t&)> body)
+{
+    vector<double> seconds;
+    uint64_t packets = 0, bytes = 0, total_packets = 0;
+    perf_counts_t counts;
+
+    if (!cold) warm_cache(filename);
+
+    for (int rep=0; rep<reps; ++rep)
+    {
+        if (cold) drop_cache(filename);
+
+        packets = bytes = 0;
+        perf.start();
+        auto start = chrono::steady_clock::now();
+        body(packets, bytes);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        perf.stop();
+        seconds.push_back(elapsed.count());
+        counts += perf.read();
+        total_packets += packets;
+    }
+
+    sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+
+    char line[1024];
+    int length = snprintf(line, sizeof(line),
+        "{\"suite\":\"%s\",\"case\":\"%s\",\"cache\":\"%s\",\"size_mb\":%s,\"dist\":\"%s\","
+        "\"packets\":%lu,\"bytes\":%lu,\"seconds\":%.6f,\"seconds_min\":%.6f,\"pps\":%.0f,\"gbps\":%.3f",
+        suite, name, cold ? "cold" : "warm", size.c_str(), dist.c_str(), packets, bytes,
+        median, seconds[0], packets / median, bytes / median / 1e9);
+
+    if (total_packets && counts.has(PERF_CYCLES))
+    {
+        length += snprintf(line + length, sizeof(line) - length, ",\"cycles_per_packet\":%.3f",
+            (double)counts.value[PERF_CYCLES] / total_packets);
+    }
+
+    snprintf(line + length, sizeof(line) - length, "}\n");
+
+    fputs(line, stdout);
+    fflush(stdout);
+    if (out_file) fputs(line, out_file);
+}
+//=============================================================================
+
+
+//=============================================================================
+// open_libpcap() - Opens a capture with libpcap
+//=============================================================================
+static pcap_t* open_libpcap(const string& filename)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t* pcap = pcap_open_offline(filename.c_str(), errbuf);
+    if (pcap == nullptr) throwRuntime("pcap_open_offline failed on %s: %s", filename.c_str(), errbuf);
+    return pcap;
+}
+//=============================================================================
+
+
+//=============================================================================
+// count_packet() - The pcap_dispatch() callback
+//=============================================================================
+static void count_packet(u_char* user, const struct pcap_pkthdr* header, const u_char* data)
+{
+    totals_t* totals = (totals_t*)user;
+    ++totals->packets;
+    totals->bytes += header->caplen;
+    sink += data[0];
+}
+//=============================================================================
+
+
+//=============================================================================
+// bench_file() - Measures libpcap and every mode of CPcapReader on one file
+//=============================================================================
+static void bench_file(const string& filename, const string& size, bool cold)
+{
+    report("libpcap", "pcap_next_ex", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        pcap_t* pcap = open_libpcap(filename);
+        struct pcap_pkthdr* header;
+        const u_char* data;
+        while (pcap_next_ex(pcap, &header, &data) == 1) {++packets; bytes += header->caplen; sink += data[0];}
+        pcap_close(pcap);
+    });
+
+    report("libpcap", "pcap_dispatch", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        pcap_t* pcap = open_libpcap(filename);
+        totals_t totals = {0, 0};
+        while (pcap_dispatch(pcap, -1, count_packet, (u_char*)&totals) > 0);
+        pcap_close(pcap);
+        packets = totals.packets;
+        bytes   = totals.bytes;
+    });
+
+    report("pcapreader", "fread", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        static pcap_packet_t packet;
+        reader.open(filename);
+        while (reader.get_next_packet(&packet)) {++packets; bytes += packet.length; sink += packet.data[0];}
+    });
+
+    report("pcapreader", "view", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        reader.open(filename);
+        for (auto& packet : reader) {++packets; bytes += packet.length; sink += packet.data[0];}
+    });
+
+    report("pcapreader", "batch", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        CPacketBatch batch;
+        reader.open(filename);
+        while (reader.get_next_batch(batch))
+        {
+            for (auto& packet : batch) {++packets; bytes += packet.length; sink += packet.data[0];}
+        }
+    });
+
+    report("pcapreader", "for_each", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CPcapReader reader;
+        reader.open(filename);
+        packets = for_each_packet(reader, [&](const packet_view_t& packet)
+        {
+            bytes += packet.length;
+            sink += packet.data[0];
+        });
+    });
+
+    report("pcapreader", "shared", filename, size, cold, [&](uint64_t& packets, uint64_t& bytes)
+    {
+        CBlockPool pool;
+        CPcapReader reader;
+        shared_packet_t packet;
+        reader.set_block_pool(&pool);
+        reader.open(filename);
+        while (reader.get_next_shared(&packet)) {++packets; bytes += packet.view.length; sink += packet.view.data[0];}
+        packet.block.reset();
+    });
+}
+//=============================================================================
+
+
+//=============================================================================
+// split() - Splits a comma-separated list
+//=============================================================================
+static vector<string> split(const string& list)
+{
+    vector<string> result;
+    size_t start = 0, comma;
+    while ((comma = list.find(',', start)) != string::npos)
+    {
+        result.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    result.push_back(list.substr(start));
+    return result;
+}
+//=============================================================================
+
+
+//=============================================================================
+// parse_command_line() - Fetches the options from the command line
+//=============================================================================
+static void parse_command_line(int argc, char** argv)
+{
+    for (int i=1; i<argc; ++i)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc) throw runtime_error("Missing value for " + option);
+        string value = argv[++i];
+
+        if      (option == "-sizes") sizes    = split(value);
+        else if (option == "-reps" ) reps     = max(1, atoi(value.c_str()));
+        else if (option == "-dist" ) dist     = value;
+        else if (option == "-dir"  ) dir      = value;
+        else if (option == "-out"  ) out_name = value;
+        else throw runtime_error("Unknown option " + option);
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// execute() - Runs every case over every file size, warm and cold
+//=============================================================================
+static void execute(int argc, char** argv)
+{
+    parse_command_line(argc, argv);
+
+    if (!perf.open()) fprintf(stderr, "Hardware performance counters are unavailable\n");
+
+    if (!out_name.empty())
+    {
+        out_file = fopen(out_name.c_str(), "w");
+        if (out_file == nullptr) throw runtime_error("Can't create " + out_name);
+    }
+
+    for (const string& size : sizes)
+    {
+        string filename = dir + "/libpcapbench_" + size + "_" + to_string(getpid()) + ".pcap";
+
+        pcap_generator_config_t config;
+        config.total_bytes = (size_t)atoi(size.c_str()) << 20;
+        config.size_mix    = dist;
+        config.timestamps  = "jitter:550";
+        CPcapGenerator(config).write(filename);
+
+        bench_file(filename, size, false);
+        bench_file(filename, size, true);
+
+        remove(filename.c_str());
+    }
+
+    if (out_file) fclose(out_file);
+}
+//=============================================================================
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        execute(argc, argv);
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,767 @@
+//=============================================================================
+// pcapdiff.cpp - Checks that every way of reading a PCAP file agrees with
+//                the original fread()-based get_next_packet().
+//
+// Each backend reads the same files, and for every packet we hash the
+// timestamp, length and data, and the headers as that backend parsed them.
+// The hashes are compared, packet by packet, against the reference.  The
+// files are a set of generated captures (clean, mixed protocols,
+// microsecond timestamps, corrupt, truncated), the sample captures if
+// they're in the current directory, and any files named on the command line.
+//
+// Backends that can't carry on past a corrupt record (because they report
+// corruption by throwing) are only compared on files without corruption.
+// The random-access backend is only compared on files whose records are
+// all the same size.
+//
+// After checking, each backend is timed over each file, and the throughputs
+// are printed side by side.  The exit status is 1 if anything disagreed.
+//
+// Usage: pcapdiff [-size <MB>] [-reps <n>] [-dir <path>] [file ...]
+//=============================================================================
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "pcap_reader.h"
+#include "pcap_set_reader.h"
+#include "pcap_reader_c.h"
+#include "packet_parse.h"
+#include "for_each_packet.h"
+#include "header_columns.h"
+#include "pcap_generator.h"
+
+using namespace std;
+
+// Command line options
+static size_t           size_mb = 16;
+static int              reps    = 3;
+static string           dir     = "/tmp";
+static vector<string>   extra_files;
+
+// Summed from packet data so the compiler can't discard the work
+static volatile uint64_t sink;
+
+
+//=============================================================================
+// The parsed headers of a packet in one canonical form, whichever parser
+// produced them.  Parsers that only produce some of the fields leave the
+// rest zero.
+//=============================================================================
+struct canon_t
+{
+    uint8_t     layers, ip4_version, ip4_dsf, ip4_ttl, ip4_protocol;
+    uint8_t     eth_dst_mac[6], eth_src_mac[6];
+    uint16_t    eth_type, ip4_length, ip4_id, ip4_flags, ip4_checksum;
+    uint16_t    udp_src_port, udp_dst_port, udp_length, udp_checksum, rdmx_magic;
+    uint32_t    ip4_src_ip, ip4_dst_ip;
+    uint64_t    rdmx_target;
+};
+//=============================================================================
+
+
+//=============================================================================
+// What we record about each packet
+//=============================================================================
+struct record_t
+{
+    // The timestamp, length and data
+    uint64_t    packet;
+
+    // Every header field, and just the fields that every parser produces
+    uint64_t    full, core;
+};
+//=============================================================================
+
+
+//=============================================================================
+// hash_bytes() - A fast, non-cryptographic hash
+//=============================================================================
+static uint64_t hash_bytes(const void* data, size_t length, uint64_t h = 0x9E3779B97F4A7C15ull)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t word;
+
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        memcpy(&word, p, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+
+    word = 0;
+    memcpy(&word, p, length);
+    h = (h ^ word ^ length) * 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 29);
+}
+//=============================================================================
+
+
+//=============================================================================
+// canonical() - Converts parsed headers to the canonical form.  This works
+//               for eth_header_t and pcapr_eth_header_t, which have the
+//               same fields, and for eth_header_compact_t.
+//=============================================================================
+template <class H> static void copy_fields(const H& h, canon_t& c)
+{
+    memcpy(c.eth_dst_mac, h.eth_dst_mac, 6);
+    memcpy(c.eth_src_mac, h.eth_src_mac, 6);
+    c.eth_type     = h.eth_type;
+    c.ip4_version  = h.ip4_version;
+    c.ip4_dsf      = h.ip4_dsf;
+    c.ip4_length   = h.ip4_length;
+    c.ip4_id       = h.ip4_id;
+    c.ip4_flags    = h.ip4_flags;
+    c.ip4_ttl      = h.ip4_ttl;
+    c.ip4_protocol = h.ip4_protocol;
+    c.ip4_checksum = h.ip4_checksum;
+    c.ip4_src_ip   = h.ip4_src_ip;
+    c.ip4_dst_ip   = h.ip4_dst_ip;
+    c.udp_src_port = h.udp_src_port;
+    c.udp_dst_port = h.udp_dst_port;
+    c.udp_length   = h.udp_length;
+    c.udp_checksum = h.udp_checksum;
+    c.rdmx_magic   = h.rdmx_magic;
+    c.rdmx_target  = h.rdmx_target;
+}
+
+template <class H> static canon_t canonical(const H& h)
+{
+    canon_t c;
+    memset(&c, 0, sizeof(c));
+    copy_fields(h, c);
+    c.layers = h.is_ethernet + h.is_ipv4 + h.is_udp + h.is_rdmx;
+    return c;
+}
+
+static canon_t canonical(const eth_header_compact_t& h)
+{
+    canon_t c;
+    memset(&c, 0, sizeof(c));
+    copy_fields(h, c);
+    c.layers = h.layers;
+    return c;
+}
+
+static canon_t canonical(const CHeaderColumns& columns, size_t i)
+{
+    canon_t c;
+    memset(&c, 0, sizeof(c));
+    c.layers       = columns.layers[i];
+    c.eth_type     = columns.eth_type[i];
+    c.ip4_protocol = columns.ip4_protocol[i];
+    c.ip4_src_ip   = columns.ip4_src_ip[i];
+    c.ip4_dst_ip   = columns.ip4_dst_ip[i];
+    c.udp_src_port = columns.udp_src_port[i];
+    c.udp_dst_port = columns.udp_dst_port[i];
+    c.udp_length   = columns.udp_length[i];
+    c.rdmx_target  = columns.rdmx_target[i];
+    return c;
+}
+
+static canon_t canonical(const pcapr_columns_t& columns, size_t i)
+{
+    canon_t c;
+    memset(&c, 0, sizeof(c));
+    c.layers       = columns.layers[i];
+    c.eth_type     = columns.eth_type[i];
+    c.ip4_protocol = columns.ip4_protocol[i];
+    c.ip4_src_ip   = columns.ip4_src_ip[i];
+    c.ip4_dst_ip   = columns.ip4_dst_ip[i];
+    c.udp_src_port = columns.udp_src_port[i];
+    c.udp_dst_port = columns.udp_dst_port[i];
+    c.udp_length   = columns.udp_length[i];
+    c.rdmx_target  = columns.rdmx_target[i];
+    return c;
+}
+//=============================================================================
+
+
+//=============================================================================
+// trim_to_length() - The parsers always look at the first 52 bytes of a 
+//                    packet.  In a shorter packet, the fields past the end
+//                    come from whatever follows the packet in memory, which
+//                    differs from backend to backend.  This clears them, and
+//                    the layers they'd have made us recognize.
+//=============================================================================
+static void trim_to_length(canon_t& c, uint32_t length)
+{
+    if (length < 52)
+    {
+        c.rdmx_magic  = 0;
+        c.rdmx_target = 0;
+        c.layers      = min<uint8_t>(c.layers, 3);
+    }
+
+    if (length < 42)
+    {
+        c.udp_src_port = c.udp_dst_port = c.udp_length = c.udp_checksum = 0;
+        c.layers = min<uint8_t>(c.layers, 2);
+    }
+
+    if (length < 34)
+    {
+        c.ip4_version = c.ip4_dsf = c.ip4_ttl = c.ip4_protocol = 0;
+        c.ip4_length = c.ip4_id = c.ip4_flags = c.ip4_checksum = 0;
+        c.ip4_src_ip = c.ip4_dst_ip = 0;
+        c.layers = min<uint8_t>(c.layers, 1);
+    }
+
+    if (length < 14)
+    {
+        memset(c.eth_dst_mac, 0, 6);
+        memset(c.eth_src_mac, 0, 6);
+        c.eth_type = 0;
+        c.layers   = 0;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// make_record() - Hashes a packet and its parsed headers
+//=============================================================================
+static record_t make_record(const packet_view_t& packet, canon_t c)
+{
+    record_t record;
+    trim_to_length(c, packet.length);
+
+    uint32_t fields[3] = {packet.ts_seconds, packet.ts_nanoseconds, packet.length};
+    record.packet = hash_bytes(packet.data, packet.length, hash_bytes(fields, sizeof(fields)));
+    record.full   = hash_bytes(&c, sizeof(c));
+
+    canon_t core;
+    memset(&core, 0, sizeof(core));
+    core.layers       = c.layers;
+    core.eth_type     = c.eth_type;
+    core.ip4_protocol = c.ip4_protocol;
+    core.ip4_src_ip   = c.ip4_src_ip;
+    core.ip4_dst_ip   = c.ip4_dst_ip;
+    core.udp_src_port = c.udp_src_port;
+    core.udp_dst_port = c.udp_dst_port;
+    core.udp_length   = c.udp_length;
+    core.rdmx_target  = c.rdmx_target;
+    record.core = hash_bytes(&core, sizeof(core));
+
+    return record;
+}
+//=============================================================================
+
+
+//=============================================================================
+// The backends.  Each reads a whole file, handing every packet and its
+// parsed headers to "visit".
+//=============================================================================
+
+// The reference: the original fread() path and the original parser
+struct fread_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        static pcap_packet_t packet;
+        eth_header_t header;
+        reader.open(filename);
+
+        while (true)
+        {
+            pcap_status_t status = reader.try_get_next_packet(&packet);
+            if (status == pcap_status_t::bad_length && reader.skip_bad_record() == pcap_status_t::ok) continue;
+            if (status != pcap_status_t::ok) break;
+
+            reader.parse_packet_headers(packet.data, &header);
+            packet_view_t view = {packet.ts_seconds, packet.ts_nanoseconds, packet.length, packet.data};
+            visit(view, canonical(header));
+        }
+    }
+};
+
+// Views into the block, with the templated parser
+struct view_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        packet_view_t packet;
+        eth_header_t header;
+        reader.open(filename);
+
+        while (true)
+        {
+            pcap_status_t status = reader.try_get_next_view(&packet);
+            if (status == pcap_status_t::bad_length && reader.skip_bad_record() == pcap_status_t::ok) continue;
+            if (status != pcap_status_t::ok) break;
+
+            parse_headers<parse_depth_t::rdmx>(packet.data, &header);
+            visit(packet, canonical(header));
+        }
+    }
+};
+
+// Shared packets from a pool, with the compact parser
+struct shared_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CBlockPool pool;
+        CPcapReader reader;
+        shared_packet_t packet;
+        eth_header_compact_t header;
+        reader.set_block_pool(&pool);
+        reader.open(filename);
+
+        while (true)
+        {
+            pcap_status_t status = reader.try_get_next_shared(&packet);
+            if (status == pcap_status_t::bad_length && reader.skip_bad_record() == pcap_status_t::ok) continue;
+            if (status != pcap_status_t::ok) break;
+
+            parse_compact<parse_depth_t::rdmx>(packet.view.data, &header);
+            visit(packet.view, canonical(header));
+        }
+        packet.block.reset();
+    }
+};
+
+// The range-based for loop
+struct iterator_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        eth_header_t header;
+        reader.open(filename);
+
+        for (auto& packet : reader)
+        {
+            reader.parse_packet_headers(packet.data, &header);
+            visit(packet, canonical(header));
+        }
+    }
+};
+
+// for_each_packet(), which parses the headers itself
+struct for_each_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        reader.open(filename);
+        for_each_packet<parse_depth_t::rdmx>(reader, [&](const packet_view_t& packet, const eth_header_t& header)
+        {
+            visit(packet, canonical(header));
+        });
+    }
+};
+
+// Batches, decoded into compact headers
+struct batch_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        CPacketBatch batch;
+        vector<eth_header_compact_t> headers(batch.capacity());
+        reader.open(filename);
+
+        while (reader.get_next_batch(batch))
+        {
+            decode_headers(batch, headers.data());
+            for (size_t i=0; i<batch.size(); ++i) visit(batch[i], canonical(headers[i]));
+        }
+    }
+};
+
+// Batches, decoded into columns
+struct columns_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        CPacketBatch batch;
+        CHeaderColumns columns;
+        reader.open(filename);
+
+        while (reader.get_next_batch(batch))
+        {
+            columns.decode(batch);
+            for (size_t i=0; i<batch.size(); ++i) visit(batch[i], canonical(columns, i));
+        }
+    }
+};
+
+// A rotation set of one file.  Bracketing the last character makes the
+// name a glob pattern that matches just that file.
+struct set_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapSetReader reader;
+        static pcap_packet_t packet;
+        eth_header_t header;
+        reader.open(filename.substr(0, filename.size() - 1) + "[" + filename.back() + "]");
+
+        while (reader.get_next_packet(&packet))
+        {
+            parse_headers<parse_depth_t::rdmx>(packet.data, &header);
+            packet_view_t view = {packet.ts_seconds, packet.ts_nanoseconds, packet.length, packet.data};
+            visit(view, canonical(header));
+        }
+    }
+};
+
+// The C interface, a packet at a time
+struct c_next_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        char error[256];
+        pcapr_reader_t* reader = pcapr_open(filename.c_str(), error, sizeof(error));
+        if (reader == nullptr) throw runtime_error(error);
+
+        pcapr_packet_t packet;
+        pcapr_eth_header_t header;
+        while (true)
+        {
+            pcapr_status_t status = pcapr_next(reader, &packet);
+            if (status == PCAPR_BAD_LENGTH && pcapr_skip_bad_record(reader) == PCAPR_OK) continue;
+            if (status != PCAPR_OK) break;
+
+            pcapr_parse_headers(packet.data, &header);
+            packet_view_t view = {packet.ts_seconds, packet.ts_nanoseconds, packet.length, packet.data};
+            visit(view, canonical(header));
+        }
+
+        pcapr_close(reader);
+    }
+};
+
+// The C interface, in batches of columns
+struct c_columns_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        char error[256];
+        pcapr_reader_t* reader = pcapr_open(filename.c_str(), error, sizeof(error));
+        if (reader == nullptr) throw runtime_error(error);
+
+        pcapr_columns_t columns;
+        while (true)
+        {
+            pcapr_status_t status = pcapr_next_columns(reader, 1024, &columns);
+            if (status == PCAPR_BAD_LENGTH && pcapr_skip_bad_record(reader) == PCAPR_OK) continue;
+            if (status != PCAPR_OK) break;
+
+            for (size_t i=0; i<columns.count; ++i)
+            {
+                packet_view_t view = {columns.ts_seconds[i], columns.ts_nanoseconds[i], columns.length[i],
+                                      columns.data_base + columns.data_offset[i]};
+                visit(view, canonical(columns, i));
+            }
+        }
+
+        pcapr_close(reader);
+    }
+};
+//=============================================================================
+
+
+// Random access by record number, on files whose records are all one size
+struct stride_backend
+{
+    template <class V> static void run(const string& filename, V&& visit)
+    {
+        CPcapReader reader;
+        static pcap_packet_t packet;
+        eth_header_t header;
+        reader.open(filename);
+
+        uint64_t count = reader.record_count();
+        for (uint64_t i=0; i<count && reader.read_packet_at(i, &packet); ++i)
+        {
+            parse_headers<parse_depth_t::rdmx>(packet.data, &header);
+            packet_view_t view = {packet.ts_seconds, packet.ts_nanoseconds, packet.length, packet.data};
+            visit(view, canonical(header));
+        }
+    }
+};
+//=============================================================================
+
+
+//=============================================================================
+// How we drive a backend
+//=============================================================================
+struct backend_t
+{
+    const char* name;
+
+    // Can it carry on past a corrupt record?
+    bool        recovers;
+
+    // Does its parser produce every header field, or only the core ones?
+    bool        full_headers;
+
+    // Does it only work on files with a constant record stride?
+    bool        needs_stride;
+
+    // Reads a file, recording every packet
+    function<void(const string&, vector<record_t>&)> record;
+
+    // Reads a file as fast as it can, counting the packets and bytes
+    function<void(const string&, uint64_t&, uint64_t&)> count;
+};
+
+template <class B> static backend_t make_backend(const char* name, bool recovers, bool full_headers,
+                                                 bool needs_stride = false)
+{
+    backend_t backend;
+    backend.name         = name;
+    backend.recovers     = recovers;
+    backend.full_headers = full_headers;
+    backend.needs_stride = needs_stride;
+
+    backend.record = [](const string& filename, vector<record_t>& records)
+    {
+        B::run(filename, [&](const packet_view_t& packet, const canon_t& c) {records.push_back(make_record(packet, c));});
+    };
+
+    backend.count = [](const string& filename, uint64_t& packets, uint64_t& bytes)
+    {
+        B::run(filename, [&](const packet_view_t& packet, const canon_t& c)
+        {
+            ++packets;
+            bytes += packet.length;
+            sink += c.layers + packet.data[0];
+        });
+    };
+
+    return backend;
+}
+
+static const vector<backend_t> backends =
+{
+    make_backend<fread_backend>     ("fread",     true,  true ),
+    make_backend<view_backend>      ("view",      true,  true ),
+    make_backend<shared_backend>    ("shared",    true,  true ),
+    make_backend<iterator_backend>  ("iterator",  false, true ),
+    make_backend<for_each_backend>  ("for_each",  false, true ),
+    make_backend<batch_backend>     ("batch",     false, true ),
+    make_backend<columns_backend>   ("columns",   false, false),
+    make_backend<set_backend>       ("set",       false, true ),
+    make_backend<c_next_backend>    ("c_next",    true,  true ),
+    make_backend<c_columns_backend> ("c_columns", true,  false),
+    make_backend<stride_backend>    ("stride",    false, true,  true),
+};
+//=============================================================================
+
+
+//=============================================================================
+// compare() - Compares a backend's records with the reference's.  Returns
+//             a description of the first difference, or "" if they agree.
+//=============================================================================
+static string compare(const vector<record_t>& expected, const vector<record_t>& actual, bool full_headers)
+{
+    char text[128];
+    size_t count = min(expected.size(), actual.size());
+
+    for (size_t i=0; i<count; ++i)
+    {
+        const char* what = nullptr;
+        if      (expected[i].packet != actual[i].packet)                  what = "data";
+        else if (expected[i].core   != actual[i].core)                    what = "headers";
+        else if (full_headers && expected[i].full != actual[i].full)      what = "headers";
+        if (what == nullptr) continue;
+
+        snprintf(text, sizeof(text), "packet %zu: %s differ", i, what);
+        return text;
+    }
+
+    if (expected.size() != actual.size())
+    {
+        snprintf(text, sizeof(text), "%zu packets, expected %zu", actual.size(), expected.size());
+        return text;
+    }
+
+    return "";
+}
+//=============================================================================
+
+
+//=============================================================================
+// check_file() - Checks every backend against the reference on one file,
+//                then times them.  Returns false if any of them disagreed.
+//=============================================================================
+static bool check_file(const string& filename, const string& label)
+{
+    bool ok = true;
+
+    // Find out what the reference makes of the file
+    vector<record_t> expected;
+    backends[0].record(filename, expected);
+
+    printf("\n%s: %zu packets\n", label.c_str(), expected.size());
+    printf("  %-10s %10s %8s %10s  %s\n", "backend", "packets", "Mpps", "GB/s", "result");
+
+    // Is there corruption the non-recovering backends would trip over?  And
+    // are the records all the same size?
+    bool corrupt = false, has_stride = false;
+    {
+        CPcapReader reader;
+        static pcap_packet_t packet;
+        reader.open(filename);
+        has_stride = (reader.record_stride() != 0);
+        pcap_status_t status;
+        while ((status = reader.try_get_next_packet(&packet)) == pcap_status_t::ok) {}
+        corrupt = (status == pcap_status_t::bad_length || status == pcap_status_t::io_error);
+    }
+
+    for (const backend_t& backend : backends)
+    {
+        if (corrupt && !backend.recovers)
+        {
+            printf("  %-10s %10s %8s %10s  skipped (stops at corruption)\n", backend.name, "-", "-", "-");
+            continue;
+        }
+
+        if (backend.needs_stride && !has_stride)
+        {
+            printf("  %-10s %10s %8s %10s  skipped (records vary in size)\n", backend.name, "-", "-", "-");
+            continue;
+        }
+
+        // Check it
+        string result;
+        vector<record_t> actual;
+        try
+        {
+            backend.record(filename, actual);
+            result = compare(expected, actual, backend.full_headers);
+        }
+        catch(const exception& e)
+        {
+            result = string("threw: ") + e.what();
+        }
+
+        // Time it
+        vector<double> seconds;
+        uint64_t packets = 0, bytes = 0;
+        for (int i=0; result.empty() && i<reps; ++i)
+        {
+            packets = bytes = 0;
+            auto start = chrono::steady_clock::now();
+            backend.count(filename, packets, bytes);
+            seconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        sort(seconds.begin(), seconds.end());
+        double median = seconds.empty() ? 0 : seconds[seconds.size() / 2];
+
+        if (result.empty() && median > 0)
+            printf("  %-10s %10zu %8.2f %10.3f  ok\n", backend.name, actual.size(), packets / median / 1e6, bytes / median / 1e9);
+        else if (result.empty())
+            printf("  %-10s %10zu %8s %10s  ok\n", backend.name, actual.size(), "-", "-");
+        else
+            printf("  %-10s %10zu %8s %10s  MISMATCH: %s\n", backend.name, actual.size(), "-", "-", result.c_str());
+
+        if (!result.empty()) ok = false;
+    }
+
+    return ok;
+}
+//=============================================================================
+
+
+//=============================================================================
+// parse_command_line() - Fetches the options from the command line
+//=============================================================================
+static void parse_command_line(int argc, char** argv)
+{
+    for (int i=1; i<argc; ++i)
+    {
+        string option = argv[i];
+        if (option[0] != '-')
+        {
+            extra_files.push_back(option);
+            continue;
+        }
+
+        if (i + 1 >= argc) throw runtime_error("Missing value for " + option);
+        string value = argv[++i];
+
+        if      (option == "-size") size_mb = atoi(value.c_str());
+        else if (option == "-reps") reps    = max(1, atoi(value.c_str()));
+        else if (option == "-dir" ) dir     = value;
+        else throw runtime_error("Unknown option " + option);
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// execute() - Generates the test files and checks every backend on them
+//=============================================================================
+static bool execute(int argc, char** argv)
+{
+    parse_command_line(argc, argv);
+
+    // The generated files: a name, and how it differs from the default
+    struct input_t {const char* name; function<void(pcap_generator_config_t&)> tweak;};
+    vector<input_t> inputs =
+    {
+        {"imix",      [](pcap_generator_config_t&   ) {}},
+        {"small",     [](pcap_generator_config_t& c) {c.size_mix = "64";}},
+        {"mixed",     [](pcap_generator_config_t& c) {c.size_mix = "uniform:20-9000"; c.vlan_fraction = 0.2;
+                                                      c.ipv6_fraction = 0.2; c.tcp_fraction = 0.2; c.rdmx_fraction = 0.5;}},
+        {"usec",      [](pcap_generator_config_t& c) {c.microseconds = true;}},
+        {"corrupt",   [](pcap_generator_config_t& c) {c.corrupt_fraction = 0.001;}},
+        {"truncated", [](pcap_generator_config_t& c) {c.truncate_last = true;}},
+        {"both",      [](pcap_generator_config_t& c) {c.corrupt_fraction = 0.01; c.truncate_last = true;}},
+    };
+
+    bool ok = true;
+
+    for (const input_t& input : inputs)
+    {
+        pcap_generator_config_t config;
+        config.total_bytes = size_mb << 20;
+        input.tweak(config);
+
+        string filename = dir + "/pcapdiff_" + input.name + "_" + to_string(getpid()) + ".pcap";
+        CPcapGenerator(config).write(filename);
+        ok = check_file(filename, input.name) && ok;
+        remove(filename.c_str());
+    }
+
+    // The sample files, if we're in the source directory
+    for (const char* sample : {"ch0_packets.pcap", "chargen-udp.pcap"})
+    {
+        if (access(sample, R_OK) == 0) ok = check_file(sample, sample) && ok;
+    }
+
+    // And whatever the caller gave us
+    for (const string& filename : extra_files) ok = check_file(filename, filename) && ok;
+
+    printf("\n%s\n", ok ? "All backends agree" : "BACKENDS DISAGREE");
+    return ok;
+}
+//=============================================================================
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        return execute(argc, argv) ? 0 : 1;
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
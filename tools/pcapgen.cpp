@@ -0,0 +1,92 @@
+//=============================================================================
+// pcapgen.cpp - Writes a synthetic PCAP file
+//
+// Usage: pcapgen -o <file> [-size <MB> | -count <packets>] [-mix <sizes>]
+//                [-flows <n>] [-vlan <fraction>] [-ipv6 <fraction>]
+//                [-tcp <fraction>] [-rdmx <fraction>] [-ts <pattern>]
+//                [-usec 1] [-corrupt <fraction>] [-truncate 1] [-seed <n>]
+//
+// See pcap_generator.h for the syntax of the size mix and timestamp pattern
+//=============================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include "pcap_generator.h"
+
+using namespace std;
+
+// Command line options
+static string                  out_name;
+static pcap_generator_config_t config;
+
+
+//=============================================================================
+// parse_command_line() - Fetches the options from the command line
+//=============================================================================
+static void parse_command_line(int argc, char** argv)
+{
+    for (int i=1; i<argc; ++i)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc) throw runtime_error("Missing value for " + option);
+        const char* value = argv[++i];
+
+        if      (option == "-o"       ) out_name                = value;
+        else if (option == "-size"    ) config.total_bytes      = strtoull(value, nullptr, 10) << 20;
+        else if (option == "-count"   ) config.packet_count     = strtoull(value, nullptr, 10);
+        else if (option == "-mix"     ) config.size_mix         = value;
+        else if (option == "-flows"   ) config.flows            = atoi(value);
+        else if (option == "-vlan"    ) config.vlan_fraction    = atof(value);
+        else if (option == "-ipv6"    ) config.ipv6_fraction    = atof(value);
+        else if (option == "-tcp"     ) config.tcp_fraction     = atof(value);
+        else if (option == "-rdmx"    ) config.rdmx_fraction    = atof(value);
+        else if (option == "-ts"      ) config.timestamps       = value;
+        else if (option == "-usec"    ) config.microseconds     = atoi(value) != 0;
+        else if (option == "-corrupt" ) config.corrupt_fraction = atof(value);
+        else if (option == "-truncate") config.truncate_last    = atoi(value) != 0;
+        else if (option == "-seed"    ) config.seed             = strtoull(value, nullptr, 10);
+        else throw runtime_error("Unknown option " + option);
+    }
+
+    if (out_name.empty()) throw runtime_error("No output file.  Use -o <file>");
+}
+//=============================================================================
+
+
+//=============================================================================
+// execute() - Writes the file and reports how long it took
+//=============================================================================
+static void execute(int argc, char** argv)
+{
+    parse_command_line(argc, argv);
+
+    CPcapGenerator generator(config);
+
+    auto start = chrono::steady_clock::now();
+    generator.write(out_name);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    printf("%s: %llu packets (%llu corrupted), %llu bytes in %.3f seconds, %.1f MB/s\n",
+        out_name.c_str(),
+        (unsigned long long)generator.packets_written(),
+        (unsigned long long)generator.packets_corrupted(),
+        (unsigned long long)generator.bytes_written(),
+        seconds, generator.bytes_written() / seconds / 1e6);
+}
+//=============================================================================
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        execute(argc, argv);
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,154 @@
+//=============================================================================
+// pcapindex.cpp - Builds the compressed packet index of a PCAP file, and
+//                 reports how big it is.
+//
+// The index is written next to the capture, with ".idx" added to its name,
+// unless -o says otherwise.  With "-verify 1", the index is then checked
+// against every packet in the capture, and the speed of looking packets up
+// in it at random is measured.
+//
+// Usage: pcapindex [-o <index file>] [-verify 1] <capture>
+//=============================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <random>
+#include <chrono>
+#include <stdexcept>
+#include "pcap_reader.h"
+#include "packet_index.h"
+
+using namespace std;
+
+// Command line options
+static string   capture;
+static string   index_file;
+static bool     verify = false;
+
+// Summed from lookups so the compiler can't discard them
+static volatile uint64_t sink;
+
+
+//=============================================================================
+// parse_command_line() - Fetches the options from the command line
+//=============================================================================
+static void parse_command_line(int argc, char** argv)
+{
+    for (int i=1; i<argc; ++i)
+    {
+        string option = argv[i];
+        if (option[0] != '-')
+        {
+            capture = option;
+            continue;
+        }
+
+        if (i + 1 >= argc) throw runtime_error("Missing value for " + option);
+        string value = argv[++i];
+
+        if      (option == "-o"     ) index_file = value;
+        else if (option == "-verify") verify     = (value == "1");
+        else throw runtime_error("Unknown option " + option);
+    }
+
+    if (capture.empty()) throw runtime_error("Usage: pcapindex [-o <index file>] [-verify 1] <capture>");
+}
+//=============================================================================
+
+
+//=============================================================================
+// check_index() - Checks the index against every packet in the capture.
+//                 Returns the number of packets that disagree.
+//=============================================================================
+static uint64_t check_index(const CPacketIndex& index)
+{
+    CPcapReader reader;
+    packet_view_t packet;
+    uint64_t i = 0, bad = 0;
+    reader.open(capture);
+    uint64_t scale = reader.is_nanosecond() ? 1 : 1000;
+
+    while (true)
+    {
+        uint64_t offset = reader.tell();
+        pcap_status_t status = reader.try_get_next_view(&packet);
+        if (status == pcap_status_t::bad_length && reader.skip_bad_record() == pcap_status_t::ok) continue;
+        if (status != pcap_status_t::ok) break;
+
+        uint64_t ns = packet.ts_seconds * 1000000000ULL + packet.ts_nanoseconds * scale;
+        if (i >= index.size() || index.offset(i) != offset || index.timestamp_ns(i) != ns) ++bad;
+        ++i;
+    }
+
+    if (i != index.size()) ++bad;
+    return bad;
+}
+//=============================================================================
+
+
+//=============================================================================
+// time_lookups() - Measures looking up random packets in the index, and
+//                  returns the nanoseconds per lookup
+//=============================================================================
+static double time_lookups(const CPacketIndex& index, bool timestamps)
+{
+    const int LOOKUPS = 1000000;
+    mt19937_64 random(1);
+    uniform_int_distribution<uint64_t> packet(0, index.size() - 1);
+
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<LOOKUPS; ++i)
+    {
+        uint64_t p = packet(random);
+        sink += timestamps ? index.timestamp_ns(p) : index.offset(p);
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+
+    return elapsed.count() / LOOKUPS;
+}
+//=============================================================================
+
+
+//=============================================================================
+// execute() - Builds the index, and checks it if asked to
+//=============================================================================
+static bool execute(int argc, char** argv)
+{
+    parse_command_line(argc, argv);
+    if (index_file.empty()) index_file = capture + ".idx";
+
+    auto start = chrono::steady_clock::now();
+    uint64_t packets = CPacketIndex::build(capture, index_file);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    CPacketIndex index;
+    index.open(capture, index_file);
+    printf("%s: %lu packets indexed in %.3f seconds\n", index_file.c_str(), packets, elapsed.count());
+    printf("  %zu bytes, %.2f bits per packet\n", index.file_size(),
+        packets ? index.file_size() * 8.0 / packets : 0.0);
+
+    if (!verify || packets == 0) return true;
+
+    uint64_t bad = check_index(index);
+    printf("  %s\n", bad ? "INDEX DISAGREES WITH CAPTURE" : "every packet matches the capture");
+    printf("  random lookups: %.1f ns per offset, %.1f ns per timestamp\n",
+        time_lookups(index, false), time_lookups(index, true));
+
+    return bad == 0;
+}
+//=============================================================================
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        return execute(argc, argv) ? 0 : 1;
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
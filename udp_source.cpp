@@ -0,0 +1,292 @@
+//=============================================================================
+// udp_source.cpp - A live source of packets that receives UDP datagrams
+//                  from a socket, a batch at a time, via recvmmsg().
+//=============================================================================
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdarg>
+#include <stdexcept>
+#include "udp_source.h"
+
+using namespace std;
+
+// The amount of control-message space each datagram's timestamp and drop
+// count need
+static const size_t CONTROL_SIZE = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t));
+
+
+//=============================================================================
+// throwRuntime() - Throws a runtime exception
+//=============================================================================
+[[noreturn]] static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=============================================================================
+
+
+//=============================================================================
+// Constructor
+//=============================================================================
+CUdpSource::CUdpSource()
+{
+    sd_         = -1;
+    stop_       = false;
+    drops_      = 0;
+    timeout_ms_ = 100;
+    local_ip_   = 0;
+    local_port_ = 0;
+    slot_size_  = 0;
+    budget_     = nullptr;
+    charged_    = 0;
+}
+//=============================================================================
+
+
+//=============================================================================
+// Destructor
+//=============================================================================
+CUdpSource::~CUdpSource()
+{
+    close();
+
+    // Give back the memory the receive buffers were charged against
+    if (budget_) budget_->release(charged_);
+}
+//=============================================================================
+
+
+//=============================================================================
+// open() - Creates the socket, binds it, and preallocates the buffers that
+//          recvmmsg() will receive into
+//=============================================================================
+void CUdpSource::open(uint16_t port, string bind_address, size_t max_batch, size_t slot_size)
+{
+    // Make sure we're not holding onto a previous socket
+    close();
+    stop_ = false;
+
+    if (max_batch == 0 || slot_size <= HEADER_SIZE)
+        throwRuntime("Bad UDP source geometry: batch %zu, slot %zu", max_batch, slot_size);
+
+    // Create the socket
+    sd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sd_ < 0) throwRuntime("Can't create UDP socket: %s", strerror(errno));
+
+    // Ask the kernel to timestamp each datagram as it arrives
+    int on = 1;
+    if (setsockopt(sd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+        throwRuntime("Can't enable SO_TIMESTAMPNS: %s", strerror(errno));
+
+    // And to tell us how many datagrams it has dropped for lack of buffer
+    // space.  Older kernels don't support this, and we can live without it.
+    setsockopt(sd_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    drops_ = 0;
+
+    // Bind to the requested address and port
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1)
+        throwRuntime("Bad bind address %s", bind_address.c_str());
+    if (bind(sd_, (sockaddr*)&addr, sizeof(addr)) < 0)
+        throwRuntime("Can't bind to %s:%u: %s", bind_address.c_str(), port, strerror(errno));
+
+    // Find out which port we actually got, in case the caller asked for 0
+    socklen_t addr_len = sizeof(addr);
+    getsockname(sd_, (sockaddr*)&addr, &addr_len);
+    local_ip_   = ntohl(addr.sin_addr.s_addr);
+    local_port_ = ntohs(addr.sin_port);
+
+    // Apply the receive timeout
+    set_timeout(timeout_ms_);
+
+    // Pay for the receive buffers, swapping the charge for any we had before
+    if (budget_)
+    {
+        size_t cost = max_batch * (slot_size + sizeof(mmsghdr) + sizeof(iovec) + sizeof(sockaddr_in) + CONTROL_SIZE);
+        budget_->release(charged_);
+        charged_ = 0;
+        budget_->reserve(cost);
+        charged_ = cost;
+    }
+
+    // Allocate the receive slots, and point the message headers at them.  
+    // Each datagram lands just past the room left for its synthesized headers.
+    slot_size_ = slot_size;
+    slots_.assign(max_batch * slot_size, 0);
+    msgs_.assign(max_batch, mmsghdr());
+    iovecs_.resize(max_batch);
+    addrs_.resize(max_batch);
+    control_.assign(max_batch * CONTROL_SIZE, 0);
+    for (size_t i=0; i<max_batch; ++i)
+    {
+        iovecs_[i].iov_base = slots_.data() + i * slot_size + HEADER_SIZE;
+        iovecs_[i].iov_len  = slot_size - HEADER_SIZE;
+
+        msghdr& hdr        = msgs_[i].msg_hdr;
+        hdr.msg_name       = &addrs_[i];
+        hdr.msg_namelen    = sizeof(sockaddr_in);
+        hdr.msg_iov        = &iovecs_[i];
+        hdr.msg_iovlen     = 1;
+        hdr.msg_control    = control_.data() + i * CONTROL_SIZE;
+        hdr.msg_controllen = CONTROL_SIZE;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// set_timeout() - Sets how long a receive waits before giving up
+//=============================================================================
+void CUdpSource::set_timeout(int milliseconds)
+{
+    timeout_ms_ = milliseconds;
+    if (sd_ < 0) return;
+
+    timeval tv;
+    tv.tv_sec  = milliseconds / 1000;
+    tv.tv_usec = (milliseconds % 1000) * 1000;
+    setsockopt(sd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+//=============================================================================
+
+
+//=============================================================================
+// close() - Closes the socket if it's open
+//=============================================================================
+void CUdpSource::close()
+{
+    if (sd_ >= 0)
+    {
+        ::close(sd_);
+        sd_ = -1;
+    }
+}
+//=============================================================================
+
+
+//=============================================================================
+// build_headers() - Fills in the Ethernet, IPv4 and UDP headers that sit in
+//                   front of a received datagram, in network byte order
+//=============================================================================
+void CUdpSource::build_headers(uint8_t* frame, const sockaddr_in& from, uint32_t length)
+{
+    uint16_t ip4_length = htons(20 + 8 + length);
+    uint16_t udp_length = htons( 8 + length);
+    uint32_t dst_ip     = htonl(local_ip_);
+    uint16_t dst_port   = htons(local_port_);
+
+    // Ethernet: zeroed MAC addresses, followed by type IPv4
+    memset(frame, 0, 12);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    // IPv4: version/IHL, DSF, length, ID, flags, TTL, protocol, checksum,
+    // source IP, destination IP
+    uint8_t* ip4 = frame + 14;
+    ip4[0] = 0x45;
+    ip4[1] = 0;
+    memcpy(ip4 + 2, &ip4_length, 2);
+    memset(ip4 + 4, 0, 4);
+    ip4[8] = 64;
+    ip4[9] = 0x11;
+    memset(ip4 + 10, 0, 2);
+    memcpy(ip4 + 12, &from.sin_addr.s_addr, 4);
+    memcpy(ip4 + 16, &dst_ip, 4);
+
+    // UDP: source port, destination port, length, checksum
+    uint8_t* udp = frame + 34;
+    memcpy(udp + 0, &from.sin_port, 2);
+    memcpy(udp + 2, &dst_port, 2);
+    memcpy(udp + 4, &udp_length, 2);
+    memset(udp + 6, 0, 2);
+}
+//=============================================================================
+
+
+//=============================================================================
+// get_next_batch() - Receives a batch of datagrams.
+//
+// Returns 'true' on success (possibly with an empty batch if we timed out),
+// or 'false' if the source has been stopped
+//=============================================================================
+bool CUdpSource::get_next_batch(CPacketBatch& batch)
+{
+    batch.clear();
+
+    // If we've been told to stop, there are no more packets
+    if (stop_) return false;
+
+    // If there is no socket open, complain
+    if (sd_ < 0)
+        throwRuntime("UDP source not open");
+
+    // Never receive more datagrams than the batch can hold
+    size_t count = msgs_.size();
+    if (count > batch.capacity()) count = batch.capacity();
+
+    // Reset the per-message lengths that the previous call altered
+    for (size_t i=0; i<count; ++i)
+    {
+        msgs_[i].msg_hdr.msg_namelen    = sizeof(sockaddr_in);
+        msgs_[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+    }
+
+    // Wait for at least one datagram, then take whatever else is waiting
+    int received = recvmmsg(sd_, msgs_.data(), count, MSG_WAITFORONE, nullptr);
+
+    // A timeout or an interrupted call just yields an empty batch
+    if (received < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return !stop_;
+        throwRuntime("recvmmsg failed: %s", strerror(errno));
+    }
+
+    // Fill in a view of each datagram
+    packet_view_t* views = batch.views();
+    for (int i=0; i<received; ++i)
+    {
+        msghdr&  hdr    = msgs_[i].msg_hdr;
+        uint8_t* frame  = slots_.data() + i * slot_size_;
+        uint32_t length = msgs_[i].msg_len;
+
+        // If the datagram was bigger than the slot, we kept the front of it
+        if (length > iovecs_[i].iov_len) length = iovecs_[i].iov_len;
+
+        // Find the kernel's receive timestamp, and its count of the 
+        // datagrams it has dropped so far
+        timespec ts = {0, 0};
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET) continue;
+            if (cmsg->cmsg_type == SCM_TIMESTAMPNS) memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            if (cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                drops_.store(drops, memory_order_relaxed);
+            }
+        }
+
+        build_headers(frame, addrs_[i], msgs_[i].msg_len);
+
+        views[i].ts_seconds     = ts.tv_sec;
+        views[i].ts_nanoseconds = ts.tv_nsec;
+        views[i].length         = HEADER_SIZE + length;
+        views[i].data           = frame;
+    }
+
+    batch.set_size(received);
+    return true;
+}
+//=============================================================================
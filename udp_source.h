@@ -0,0 +1,94 @@
+//=============================================================================
+// udp_source.h - A live source of packets that receives UDP datagrams from
+//                a socket, a batch at a time, via recvmmsg().
+//
+// Each datagram is handed back as though it were an Ethernet/IPv4/UDP frame
+// from a PCAP file: the Ethernet, IPv4 and UDP headers are filled in from
+// the socket addresses, and the timestamp is the kernel's receive time.
+// That way an analyzer can be run on live traffic or on a capture file
+// without change.
+//=============================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "packet_batch.h"
+#include "memory_budget.h"
+
+
+class CUdpSource : public CPacketSource
+{
+public:
+
+    // Constructor / destructor
+    CUdpSource();
+    ~CUdpSource();
+
+    // Call this to start listening for datagrams.  "slot_size" is the most
+    // bytes of any one frame we'll keep (including the synthesized headers),
+    // and "max_batch" is the most datagrams fetched by one recvmmsg() call.
+    // Will throw std::runtime_error on failure.
+    void    open(uint16_t port, std::string bind_address = "127.0.0.1",
+                 size_t max_batch = 1024, size_t slot_size = 10000);
+
+    // Waits for at least one datagram to arrive, then fills the batch with
+    // whatever has arrived.  Returns an empty batch if the timeout expires,
+    // and returns false once stop() has been called.
+    // Will throw std::runtime_error on failure.
+    bool    get_next_batch(CPacketBatch& batch) override;
+
+    // How long get_next_batch() waits for a datagram before returning an
+    // empty batch.  This also bounds how long stop() takes to be noticed.
+    void    set_timeout(int milliseconds);
+
+    // Charges the receive buffers against "budget".  Call this before 
+    // open(), which waits for the memory if the budget is exhausted.
+    void    set_memory_budget(CMemoryBudget* budget) {budget_ = budget;}
+
+    // Makes get_next_batch() return false.  Safe to call from any thread.
+    void    stop() {stop_ = true;}
+
+    // Call this to close the socket
+    void    close();
+
+    // The UDP port we're bound to (useful when we opened port 0)
+    uint16_t port() {return local_port_;}
+
+    // The number of datagrams the kernel has dropped because the socket's
+    // receive buffer was full.  This is as of the last datagram received,
+    // and is always zero on kernels without SO_RXQ_OVFL.  Safe to call from
+    // any thread.
+    uint64_t drops() const {return drops_.load(std::memory_order_relaxed);}
+
+protected:
+
+    // Size of the synthesized Ethernet + IPv4 + UDP headers
+    static const size_t HEADER_SIZE = 42;
+
+    // Fills in the Ethernet/IPv4/UDP headers in front of a datagram
+    void    build_headers(uint8_t* frame, const sockaddr_in& from, uint32_t length);
+
+    int     sd_;
+    std::atomic<bool> stop_;
+    std::atomic<uint64_t> drops_;
+    int     timeout_ms_;
+
+    uint32_t local_ip_;
+    uint16_t local_port_;
+
+    // One receive slot per datagram in a batch.  Each slot has room for the
+    // synthesized headers followed by the datagram itself.
+    size_t  slot_size_;
+    std::vector<uint8_t>        slots_;
+    std::vector<mmsghdr>        msgs_;
+    std::vector<iovec>          iovecs_;
+    std::vector<sockaddr_in>    addrs_;
+    std::vector<uint8_t>        control_;
+
+    // What the buffers above are charged against, and how much they cost
+    CMemoryBudget*  budget_;
+    size_t          charged_;
+};
+//=============================================================================
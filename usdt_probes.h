@@ -0,0 +1,43 @@
+//=============================================================================
+// usdt_probes.h - Static tracepoints (USDT probes) in the reader.
+//
+// When <sys/sdt.h> is available (it comes with systemtap-sdt-dev or
+// systemtap-sdt-devel), each probe compiles down to a single "nop", plus a
+// note in the ELF file that tells tracers where that nop is.  A probe costs
+// nothing until a tracer attaches to it.  Then the tracer patches in a
+// breakpoint:
+//
+//   bpftrace -e 'usdt:./readpcap:pcapreader:block_refill { @bytes = hist(arg0); }'
+//   perf probe -x ./readpcap sdt_pcapreader:corrupt_record
+//
+// The probes, and their arguments:
+//
+//   packet_read     (length, ts_seconds, ts_nanoseconds)
+//   block_refill    (bytes read, nanoseconds spent waiting for them)
+//   corrupt_record  (bad length, file offset of the record)
+//   pool_stall      (nanoseconds spent waiting for a free block)
+//   budget_stall    (bytes wanted, nanoseconds spent waiting for them)
+//   follow_stall    (milliseconds about to be slept, waiting for more data)
+//
+// Without <sys/sdt.h>, or with -DPCAPREADER_NO_PROBES, the probes compile to
+// nothing at all, and their arguments aren't evaluated.
+//=============================================================================
+#pragma once
+
+#if defined(__has_include) && !defined(PCAPREADER_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PCAPREADER_HAS_PROBES 1
+#endif
+#endif
+
+#ifdef PCAPREADER_HAS_PROBES
+#define PCAPREADER_PROBE1(name, a)          STAP_PROBE1(pcapreader, name, a)
+#define PCAPREADER_PROBE2(name, a, b)       STAP_PROBE2(pcapreader, name, a, b)
+#define PCAPREADER_PROBE3(name, a, b, c)    STAP_PROBE3(pcapreader, name, a, b, c)
+#else
+#define PCAPREADER_PROBE1(name, a)          do {} while (0)
+#define PCAPREADER_PROBE2(name, a, b)       do {} while (0)
+#define PCAPREADER_PROBE3(name, a, b, c)    do {} while (0)
+#endif
+//=============================================================================